@@ -121,11 +121,24 @@ int Application::newInstance()
     // default profile to be changed 
     processProfileChangeArgs(args,window);
 
-    // create new session
-    Session* session = createSession( window->defaultProfile() , QString() , window->viewManager() );
+    // create new session, or replay a capture if one was specified
+    Session* session = 0;
+    if ( args->isSet("replay") )
+    {
+        session = createReplaySession( window->defaultProfile() , args->getOption("replay") ,
+                                       !args->isSet("replay-fast") , window->viewManager() );
+    }
+    else
+    {
+        session = createSession( window->defaultProfile() , QString() , window->viewManager() );
+    }
 	if ( !args->isSet("close") )
 		session->setAutoClose(false);
 
+    // record the output of the session if requested
+    if ( args->isSet("capture") && !session->setCaptureFile(args->getOption("capture")) )
+        kWarning() << "Unable to record session output to" << args->getOption("capture");
+
     // if the background-mode argument is supplied, start the background session
     // ( or bring to the front if it already exists )
     if ( args->isSet("background-mode") )
@@ -295,4 +308,18 @@ Session* Application::createSession(Profile::Ptr profile, const QString& directo
 	return session;
 }
 
+Session* Application::createReplaySession(Profile::Ptr profile, const QString& fileName,
+                                          bool realTime, ViewManager* view)
+{
+    if (!profile)
+        profile = SessionManager::instance()->defaultProfile();
+
+    Session* session = SessionManager::instance()->createSession(profile);
+
+    view->createView(session);
+    session->replay(fileName,realTime);
+
+    return session;
+}
+
 #include "Application.moc"
@@ -89,6 +89,8 @@ private:
     MainWindow* processWindowArgs(KCmdLineArgs* args);
     void processProfileSelectArgs(KCmdLineArgs* args,MainWindow* window);
     void processProfileChangeArgs(KCmdLineArgs* args,MainWindow* window);
+    Session* createReplaySession(Profile::Ptr profile, const QString& fileName,
+                                 bool realTime, ViewManager* view);
 
     KCmdLineArgs*   _arguments;
     ProfileList*    _sessionList;
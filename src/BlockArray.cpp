@@ -46,7 +46,7 @@ BlockArray::BlockArray()
 {
     // lastmap_index = index = current = size_t(-1);
     if (blocksize == 0)
-        blocksize = ((sizeof(Block) / getpagesize()) + 1) * getpagesize();
+        blocksize = ((sizeof(Block) + getpagesize() - 1) / getpagesize()) * getpagesize();
 
 }
 
@@ -66,7 +66,7 @@ size_t BlockArray::append(Block *block)
 
     int rc;
     rc = lseek(ion, current * blocksize, SEEK_SET); if (rc < 0) { perror("HistoryBuffer::add.seek"); setHistorySize(0); return size_t(-1); }
-    rc = write(ion, block, blocksize); if (rc < 0) { perror("HistoryBuffer::add.write"); setHistorySize(0); return size_t(-1); }
+    rc = write(ion, block, sizeof(Block)); if (rc < 0) { perror("HistoryBuffer::add.write"); setHistorySize(0); return size_t(-1); }
 
     length++;
     if (length > size) length = size;
@@ -116,13 +116,13 @@ const Block* BlockArray::at(size_t i)
         kDebug(1211) << "BlockArray::at() i > index\n";
         return 0;
     }
-    
-//     if (index - i >= length) {
-//         kDebug(1211) << "BlockArray::at() index - i >= length\n";
-//         return 0;
-//     }
 
-    size_t j = i; // (current - (index - i) + (index/size+1)*size) % size ;
+    if (index - i >= length) {
+        kDebug(1211) << "BlockArray::at() index - i >= length\n";
+        return 0;
+    }
+
+    size_t j = (current + size - (index - i)) % size;
 
     assert(j < size);
     unmap();
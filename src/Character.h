@@ -25,9 +25,13 @@
 
 // Qt
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QVector>
 
 // Local
 #include "CharacterColor.h"
+#include "CharacterStyleTable.h"
 
 namespace Konsole
 {
@@ -52,6 +56,9 @@ static const int LINE_DOUBLEHEIGHT	= (1 << 2);
  * A single character in the terminal which consists of a unicode character
  * value, foreground and background colors and a set of rendition attributes
  * which specify how it should be drawn.
+ *
+ * The colors and rendition attributes are stored in the CharacterStyleTable
+ * and the character only holds the index of its style in the table.
  */
 class Character
 {
@@ -64,33 +71,55 @@ public:
    * @param _b The color used to draw the character's background.
    * @param _r A set of rendition flags which specify how this character is to be drawn.
    */
-  inline Character(quint16 _c = ' ',
-            CharacterColor  _f = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_FORE_COLOR),
-            CharacterColor  _b = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_BACK_COLOR),
+  inline Character(quint16 _c,
+            CharacterColor  _f,
+            CharacterColor  _b,
             quint8  _r = DEFAULT_RENDITION)
-       : character(_c), rendition(_r), foregroundColor(_f), backgroundColor(_b) {}
+       : character(_c), style(CharacterStyleTable::instance()->styleIndex(_f,_b,_r)) {}
+
+  /**
+   * Constructs a new character with the default colors and no rendition attributes.
+   *
+   * @param _c The unicode character value of this character.
+   */
+  inline Character(quint16 _c = ' ')
+       : character(_c), style(CharacterStyleTable::DefaultStyle) {}
 
   union
   {
     /** The unicode character value for this character. */
     quint16 character;
     /** 
-     * Experimental addition which allows a single Character instance to contain more than
-     * one unicode character.
+     * Allows a single Character instance to contain more than one unicode
+     * character, such as a base character followed by combining marks.
      *
-     * charSequence is a hash code which can be used to look up the unicode
-     * character sequence in the ExtendedCharTable used to create the sequence.
+     * If the character has the RE_EXTENDED_CHAR rendition flag, charSequence is
+     * a key which can be used to look up the unicode character sequence in the
+     * ExtendedCharTable.
      */
     quint16 charSequence; 
   };
 
-  /** A combination of RENDITION flags which specify options for drawing the character. */
-  quint8  rendition;
+  /** 
+   * The index of the character's colors and rendition attributes in the
+   * CharacterStyleTable.  Two characters have the same style if and only
+   * if they have the same index.
+   */
+  quint16 style;
+
+  /** Returns a combination of RENDITION flags which specify options for drawing the character. */
+  quint8 rendition() const
+  { return CharacterStyleTable::instance()->style(style).rendition; }
+  /** Returns the foreground color used to draw this character. */
+  const CharacterColor& foregroundColor() const
+  { return CharacterStyleTable::instance()->style(style).foregroundColor; }
+  /** Returns the color used to draw this character's background. */
+  const CharacterColor& backgroundColor() const
+  { return CharacterStyleTable::instance()->style(style).backgroundColor; }
 
-  /** The foreground color used to draw this character. */
-  CharacterColor  foregroundColor; 
-  /** The color used to draw this character's background. */
-  CharacterColor  backgroundColor;
+  /** Changes the rendition flags of this character, keeping its colors. */
+  void setRendition(quint8 rendition)
+  { style = CharacterStyleTable::instance()->withRendition(style,rendition); }
 
   /** 
    * Returns true if this character has a transparent background when
@@ -118,22 +147,18 @@ public:
 
 inline bool operator == (const Character& a, const Character& b)
 { 
-  return a.character == b.character && 
-         a.rendition == b.rendition && 
-         a.foregroundColor == b.foregroundColor && 
-         a.backgroundColor == b.backgroundColor;
+  return a.character == b.character && a.style == b.style;
 }
 
 inline bool operator != (const Character& a, const Character& b)
 {
-  return    a.character != b.character || 
-            a.rendition != b.rendition || 
-            a.foregroundColor != b.foregroundColor || 
-            a.backgroundColor != b.backgroundColor;
+  return a.character != b.character || a.style != b.style;
 }
 
 inline bool Character::isTransparent(const ColorEntry* base) const
 {
+  const CharacterColor& backgroundColor = this->backgroundColor();
+
   return ((backgroundColor._colorSpace == COLOR_SPACE_DEFAULT) && 
           base[backgroundColor._u+0+(backgroundColor._v?BASE_COLORS:0)].transparent)
       || ((backgroundColor._colorSpace == COLOR_SPACE_SYSTEM) && 
@@ -142,6 +167,8 @@ inline bool Character::isTransparent(const ColorEntry* base) const
 
 inline bool Character::isBold(const ColorEntry* base) const
 {
+  const CharacterColor& backgroundColor = this->backgroundColor();
+
   return ((backgroundColor._colorSpace == COLOR_SPACE_DEFAULT) &&
             base[backgroundColor._u+0+(backgroundColor._v?BASE_COLORS:0)].bold)
       || ((backgroundColor._colorSpace == COLOR_SPACE_SYSTEM) &&
@@ -152,10 +179,18 @@ extern unsigned short vt100_graphics[32];
 
 
 /**
- * A table which stores sequences of unicode characters, referenced
- * by hash keys.  The hash key itself is the same size as a unicode
- * character ( ushort ) so that it can occupy the same space in
- * a structure.
+ * A table which stores sequences of unicode characters, such as a base
+ * character followed by combining marks, referenced by keys.  The key
+ * itself is the same size as a unicode character ( ushort ) so that it
+ * can occupy the same space in a structure.
+ *
+ * Each sequence is stored only once.  Adding a sequence which is already
+ * in the table returns the existing key.  Sequences are reference counted,
+ * each call to createExtendedChar() adds a reference which must later be
+ * released with deref().  When the last reference to a sequence is released,
+ * its storage is freed and the key becomes available again.  Released keys
+ * are re-used in the order in which they were freed, so a key is re-used as
+ * late as possible.
  */
 class ExtendedCharTable
 {
@@ -164,42 +199,83 @@ public:
     ExtendedCharTable();
     ~ExtendedCharTable();
 
+    /**
+     * The maximum number of unicode characters in a sequence.  Combining
+     * characters which would make a sequence longer than this are discarded.
+     */
+    static const int MaximumSequenceLength = 16;
+
     /**
      * Adds a sequences of unicode characters to the table and returns
-     * a hash code which can be used later to look up the sequence
+     * a key which can be used later to look up the sequence
      * using lookupExtendedChar()
      *
-     * If the same sequence already exists in the table, the hash
-     * of the existing sequence will be returned.
+     * If the same sequence already exists in the table, the key
+     * of the existing sequence will be returned.  In both cases a reference
+     * to the sequence is added, which the caller must release using deref()
+     * when the key is no longer used.
+     *
+     * Returns 0 if the table is full.
      *
      * @param unicodePoints An array of unicode character points
-     * @param length Length of @p unicodePoints
+     * @param length Length of @p unicodePoints, which must be no more than
+     * MaximumSequenceLength
+     */
+    ushort createExtendedChar(const ushort* unicodePoints , ushort length);
+    /**
+     * Releases a reference to the sequence with the specified @p key which was
+     * added by createExtendedChar().  The sequence is removed from the table
+     * when the last reference is released.
      */
-    ushort createExtendedChar(ushort* unicodePoints , ushort length);
+    void deref(ushort key);
     /**
-     * Looks up and returns a pointer to a sequence of unicode characters
-     * which was added to the table using createExtendedChar().
+     * Looks up a sequence of unicode characters which was added to the table
+     * using createExtendedChar() and copies it into @p buffer.
      *
-     * @param hash The hash key returned by createExtendedChar()
-     * @param length This variable is set to the length of the 
-     * character sequence.
+     * @param key The key returned by createExtendedChar()
+     * @param buffer A buffer of at least MaximumSequenceLength characters
+     * into which the sequence is copied.
      *
-     * @return A unicode character sequence of size @p length.
+     * @return The length of the sequence or 0 if there is no sequence with
+     * the specified @p key.
      */
-    ushort* lookupExtendedChar(ushort hash , ushort& length) const;
+    ushort lookupExtendedChar(ushort key , ushort* buffer) const;
+
+    /** Returns the number of sequences in the table. */
+    int count() const;
 
     /** The global ExtendedCharTable instance. */
     static ExtendedCharTable instance;
 private:
-    // calculates the hash key of a sequence of unicode points of size 'length'
-    ushort extendedCharHash(ushort* unicodePoints , ushort length) const;
-    // tests whether the entry in the table specified by 'hash' matches the 
-    // character sequence 'unicodePoints' of size 'length'
-    bool extendedCharMatch(ushort hash , ushort* unicodePoints , ushort length) const;
-    // internal, maps hash keys to character sequence buffers.  The first ushort
-    // in each value is the length of the buffer, followed by the ushorts in the buffer
-    // themselves.
-    QHash<ushort,ushort*> extendedCharTable;
+    struct Entry
+    {
+        ushort* unicodePoints;
+        ushort length;
+        // key of the next entry with the same hash, or 0
+        ushort next;
+        uint hash;
+        int refCount;
+    };
+
+    // calculates the hash of a sequence of unicode points of size 'length'
+    static uint extendedCharHash(const ushort* unicodePoints , ushort length);
+    // tests whether 'entry' holds the character sequence 'unicodePoints'
+    // of size 'length'
+    static bool extendedCharMatch(const Entry& entry , const ushort* unicodePoints , ushort length);
+
+    // entries indexed by key.  The first entry is unused, so that 0 is never
+    // a valid key
+    QVector<Entry> _entries;
+    // maps the hash of a sequence to the key of the first entry in the
+    // chain of entries with that hash
+    QHash<uint,ushort> _buckets;
+    // keys of entries which have been removed, oldest first
+    QQueue<ushort> _freeKeys;
+    int _count;
+
+    // the table is shared by all emulations, which may be processing
+    // output on different threads
+    mutable QMutex _lock;
 };
 
 }
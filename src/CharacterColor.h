@@ -149,6 +149,7 @@ static const ColorEntry base_color_table[TABLE_COLORS] =
 class CharacterColor
 {
     friend class Character;
+    friend class CharacterStyleTable;
 
 public:
   /** Constructs a new CharacterColor whoose color and color space are undefined. */
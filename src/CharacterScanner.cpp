@@ -0,0 +1,99 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterScanner.h"
+
+// System
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace Konsole;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// returns the index of the lowest set bit in 'mask', which must not be 0
+static inline int lowestSetBit(uint mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ( !(mask & 1) )
+    {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+#endif
+
+int Konsole::findControlCharacter(const ushort* data, int length)
+{
+    int i = 0;
+
+    // characters are compared as unsigned values using saturating subtraction,
+    // (0x20 - c) is non-zero for C0 control characters and (0x21 - (c - 0x7F))
+    // is non-zero for DEL and the C1 control characters
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi16(0x20);
+    const __m256i del = _mm256_set1_epi16(0x7F);
+    const __m256i controlRange = _mm256_set1_epi16(0x21);
+    const __m256i zero = _mm256_setzero_si256();
+    for ( ; i+16 <= length ; i += 16 )
+    {
+        __m256i chars = _mm256_loadu_si256( (const __m256i*)(data+i) );
+        __m256i c0 = _mm256_subs_epu16(space,chars);
+        __m256i c1 = _mm256_subs_epu16(controlRange,_mm256_sub_epi16(chars,del));
+        __m256i printable = _mm256_cmpeq_epi16( _mm256_or_si256(c0,c1) , zero );
+        uint mask = ~(uint)_mm256_movemask_epi8(printable);
+        if ( mask )
+            return i + lowestSetBit(mask)/2;
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi16(0x20);
+    const __m128i del = _mm_set1_epi16(0x7F);
+    const __m128i controlRange = _mm_set1_epi16(0x21);
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i+8 <= length ; i += 8 )
+    {
+        __m128i chars = _mm_loadu_si128( (const __m128i*)(data+i) );
+        __m128i c0 = _mm_subs_epu16(space,chars);
+        __m128i c1 = _mm_subs_epu16(controlRange,_mm_sub_epi16(chars,del));
+        __m128i printable = _mm_cmpeq_epi16( _mm_or_si128(c0,c1) , zero );
+        uint mask = _mm_movemask_epi8(printable) ^ 0xFFFF;
+        if ( mask )
+            return i + lowestSetBit(mask)/2;
+    }
+#endif
+
+    for ( ; i < length ; i++ )
+    {
+        const ushort c = data[i];
+        if ( c < 0x20 || (c >= 0x7F && c <= 0x9F) )
+            return i;
+    }
+
+    return length;
+}
@@ -0,0 +1,42 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef CHARACTERSCANNER_H
+#define CHARACTERSCANNER_H
+
+// Qt
+#include <QtCore/QtGlobal>
+
+namespace Konsole
+{
+
+/**
+ * Returns the index of the first character in @p data which is a C0 or C1
+ * control character or DEL (0x00 to 0x1F and 0x7F to 0x9F), or @p length
+ * if there is no such character.
+ *
+ * SSE2 or AVX2 instructions are used where the compiler supports them.
+ */
+int findControlCharacter(const ushort* data, int length);
+
+}
+
+#endif // CHARACTERSCANNER_H
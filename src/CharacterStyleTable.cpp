@@ -0,0 +1,264 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "CharacterStyleTable.h"
+
+// KDE
+#include <kglobal.h>
+#include <KDebug>
+
+using namespace Konsole;
+
+K_GLOBAL_STATIC( CharacterStyleTable , theCharacterStyleTable )
+
+const quint16 CharacterStyleTable::DefaultStyle;
+const quint16 CharacterStyleTable::NoStyle;
+const quint16 CharacterStyleTable::FixedStyleCount;
+
+// styles which have been requested in the last RecentRequestCount requests
+// are not removed, since the caller may be about to reference them
+static const quint32 RecentRequestCount = 1024;
+// number of requests for new styles which are turned down before the table
+// looks for unused styles again, if no references have been released
+static const int ReleaseInterval = 256;
+
+CharacterStyleTable* CharacterStyleTable::instance()
+{
+    return theCharacterStyleTable;
+}
+
+CharacterStyleTable::CharacterStyleTable()
+    : _count(0)
+    , _requestCount(0)
+    , _requestsSinceRelease(ReleaseInterval)
+    , _releasedSinceRelease(0)
+{
+    for ( int i = 0 ; i < ChunkCount ; i++ )
+        _chunks[i] = 0;
+
+    // the default style must have index 0 ( DefaultStyle ) so that
+    // characters which have been zero-filled have the default style
+    CharacterStyle style;
+    style.foregroundColor = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_FORE_COLOR);
+    style.backgroundColor = CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_BACK_COLOR);
+
+    QMutexLocker locker(&_lock);
+    for ( int rendition = 0 ; rendition < FixedStyleCount ; rendition++ )
+    {
+        style.rendition = rendition;
+        addStyle(style);
+    }
+}
+
+CharacterStyleTable::~CharacterStyleTable()
+{
+    for ( int i = 0 ; i < ChunkCount ; i++ )
+        delete[] _chunks[i];
+}
+
+quint64 CharacterStyleTable::styleKey(const CharacterStyle& style)
+{
+    const CharacterColor& fg = style.foregroundColor;
+    const CharacterColor& bg = style.backgroundColor;
+
+    return (quint64)fg._colorSpace << 59 | (quint64)fg._u << 51 | (quint64)fg._v << 43 | (quint64)fg._w << 35 |
+           (quint64)bg._colorSpace << 32 | (quint64)bg._u << 24 | (quint64)bg._v << 16 | (quint64)bg._w << 8 |
+           style.rendition;
+}
+
+quint16 CharacterStyleTable::styleIndex(const CharacterColor& foregroundColor,
+                                        const CharacterColor& backgroundColor,
+                                        quint8 rendition)
+{
+    CharacterStyle style;
+    style.foregroundColor = foregroundColor;
+    style.backgroundColor = backgroundColor;
+    style.rendition = rendition;
+
+    QMutexLocker locker(&_lock);
+    return addStyle(style);
+}
+
+quint16 CharacterStyleTable::withRendition(quint16 index , quint8 rendition)
+{
+    CharacterStyle newStyle = style(index);
+    if ( newStyle.rendition == rendition )
+        return index;
+
+    newStyle.rendition = rendition;
+
+    QMutexLocker locker(&_lock);
+    return addStyle(newStyle);
+}
+
+quint16 CharacterStyleTable::reversed(quint16 index)
+{
+    QMutexLocker locker(&_lock);
+
+    Entry& entry = _chunks[index >> ChunkShift][index & ChunkMask];
+    CharacterStyle newStyle = entry.style;
+    newStyle.foregroundColor = entry.style.backgroundColor;
+    newStyle.backgroundColor = entry.style.foregroundColor;
+
+    // the reversed style may have been removed and its index re-used
+    if ( entry.reversed != NoStyle )
+    {
+        Entry& reversedEntry = _chunks[entry.reversed >> ChunkShift][entry.reversed & ChunkMask];
+        if ( reversedEntry.refCount >= 0 && styleKey(reversedEntry.style) == styleKey(newStyle) )
+        {
+            reversedEntry.lastRequest = ++_requestCount;
+            return entry.reversed;
+        }
+    }
+
+    entry.reversed = addStyle(newStyle);
+    return entry.reversed;
+}
+
+void CharacterStyleTable::ref(quint16 index)
+{
+    QMutexLocker locker(&_lock);
+
+    Entry& entry = _chunks[index >> ChunkShift][index & ChunkMask];
+    Q_ASSERT( entry.refCount >= 0 );
+    entry.refCount++;
+}
+
+void CharacterStyleTable::deref(quint16 index)
+{
+    QMutexLocker locker(&_lock);
+
+    Entry& entry = _chunks[index >> ChunkShift][index & ChunkMask];
+    Q_ASSERT( entry.refCount > 0 );
+    if ( --entry.refCount == 0 )
+        _releasedSinceRelease++;
+}
+
+int CharacterStyleTable::count() const
+{
+    QMutexLocker locker(&_lock);
+    return _count - _freeIndexes.count();
+}
+
+void CharacterStyleTable::releaseUnusedStyles()
+{
+    _requestsSinceRelease = 0;
+    _releasedSinceRelease = 0;
+
+    // the styles with the default colors are kept so that there is always
+    // a style to fall back to
+    for ( int index = FixedStyleCount ; index < _count ; index++ )
+    {
+        Entry& entry = _chunks[index >> ChunkShift][index & ChunkMask];
+        if ( entry.refCount != 0 || _requestCount - entry.lastRequest < RecentRequestCount )
+            continue;
+
+        _indexes.remove(styleKey(entry.style));
+        entry.refCount = -1;
+        _freeIndexes << index;
+    }
+}
+
+CharacterColor CharacterStyleTable::approximateColor(const CharacterColor& color)
+{
+    if ( color._colorSpace != COLOR_SPACE_RGB )
+        return color;
+
+    // the 256 color palette contains a 6x6x6 color cube starting at index 16,
+    // the levels of each component are 0, 95, 135, 175, 215 and 255
+    const quint8 components[3] = { color._u , color._v , color._w };
+    int cubeIndex = 0;
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        const int value = components[i];
+        const int level = value < 48 ? 0 : ( value < 115 ? 1 : (value - 35) / 40 );
+        cubeIndex = cubeIndex * 6 + level;
+    }
+
+    return CharacterColor(COLOR_SPACE_256,16 + cubeIndex);
+}
+
+quint16 CharacterStyleTable::addStyle(const CharacterStyle& style)
+{
+    const quint64 key = styleKey(style);
+
+    _requestCount++;
+
+    const quint16 existingIndex = _indexes.value(key,NoStyle);
+    if ( existingIndex != NoStyle )
+    {
+        _chunks[existingIndex >> ChunkShift][existingIndex & ChunkMask].lastRequest = _requestCount;
+        return existingIndex;
+    }
+
+    // NoStyle is not a valid index
+    if ( _freeIndexes.isEmpty() && _count == NoStyle &&
+         (_releasedSinceRelease > 0 || ++_requestsSinceRelease >= ReleaseInterval) )
+        releaseUnusedStyles();
+
+    if ( _freeIndexes.isEmpty() && _count == NoStyle )
+    {
+        // the table is full, which can happen if a program uses many different
+        // RGB colors.  try the nearest colors from the 256 color palette
+        // instead and fall back to the default colors if that style is not
+        // in the table either
+        CharacterStyle approximateStyle = style;
+        approximateStyle.foregroundColor = approximateColor(style.foregroundColor);
+        approximateStyle.backgroundColor = approximateColor(style.backgroundColor);
+
+        const quint16 approximateIndex = _indexes.value(styleKey(approximateStyle),NoStyle);
+        if ( approximateIndex != NoStyle )
+            return approximateIndex;
+
+        static bool warned = false;
+        if ( !warned )
+        {
+            kWarning() << "Too many different character styles in use, using default colors for new styles.";
+            warned = true;
+        }
+        return style.rendition % FixedStyleCount;
+    }
+
+    quint16 index;
+    if ( !_freeIndexes.isEmpty() )
+    {
+        index = _freeIndexes.takeFirst();
+    }
+    else
+    {
+        index = _count++;
+
+        Entry*& chunk = _chunks[index >> ChunkShift];
+        if ( chunk == 0 )
+            chunk = new Entry[ChunkSize];
+    }
+
+    Entry& entry = _chunks[index >> ChunkShift][index & ChunkMask];
+    entry.style = style;
+    entry.reversed = NoStyle;
+    entry.refCount = 0;
+    entry.lastRequest = _requestCount;
+
+    _indexes.insert(key,index);
+
+    return index;
+}
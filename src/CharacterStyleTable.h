@@ -0,0 +1,190 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef CHARACTERSTYLETABLE_H
+#define CHARACTERSTYLETABLE_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+// Konsole
+#include "CharacterColor.h"
+
+namespace Konsole
+{
+
+/**
+ * The colors and rendition flags used to draw a character.
+ */
+class CharacterStyle
+{
+public:
+    /** The foreground color used to draw the character. */
+    CharacterColor foregroundColor;
+    /** The color used to draw the character's background. */
+    CharacterColor backgroundColor;
+    /** A combination of RENDITION flags which specify options for drawing the character. */
+    quint8 rendition;
+};
+
+/**
+ * A table of the different styles used by characters in the terminal.
+ *
+ * Instead of storing its colors and rendition flags itself, each Character
+ * stores the index of its style in this table.  The characters in a terminal
+ * typically use only a handful of different styles, so this makes
+ * characters much smaller, and characters can be checked for the same
+ * style by comparing their indexes.
+ *
+ * Screens reference the styles which they store with ref() and release them
+ * with deref() once no characters in the screen or its history use them.
+ * Screen windows likewise reference the styles in their images for as long
+ * as the image, or a view's copy of it, may use them.  When the table is full,
+ * styles which are not referenced and have not been requested recently are
+ * removed and their indexes are re-used.  An index which is held without a
+ * reference, such as one returned by reversed() while drawing, therefore
+ * remains valid only until many more styles have been requested.
+ *
+ * The table is shared by all emulations, which may be processing output on
+ * different threads.  Looking up a style does not take a lock, since an entry
+ * is only changed when its index is re-used, which does not happen while
+ * the style is referenced.
+ */
+class CharacterStyleTable
+{
+public:
+    CharacterStyleTable();
+    ~CharacterStyleTable();
+
+    /** Returns the global character style table. */
+    static CharacterStyleTable* instance();
+
+    /**
+     * The index of the default style, which has the default foreground
+     * and background colors and no rendition flags.
+     */
+    static const quint16 DefaultStyle = 0;
+    /**
+     * The number of styles with the default colors, one for each combination
+     * of rendition flags, which are added when the table is created.  These
+     * have the indexes below FixedStyleCount and are never removed, so they
+     * do not need to be referenced.
+     */
+    static const quint16 FixedStyleCount = 64;
+
+    /**
+     * Returns the index of the style with the specified colors and
+     * rendition flags, adding it to the table if necessary.
+     *
+     * If the table is full, the index of a style with the default colors
+     * and the same rendition flags is returned instead.
+     */
+    quint16 styleIndex(const CharacterColor& foregroundColor,
+                       const CharacterColor& backgroundColor,
+                       quint8 rendition);
+
+    /**
+     * Returns the style at @p index , which must have been returned by
+     * an earlier call to styleIndex().
+     */
+    const CharacterStyle& style(quint16 index) const
+    { return _chunks[index >> ChunkShift][index & ChunkMask].style; }
+
+    /**
+     * Returns the index of the style which is the same as the style at @p index
+     * but with @p rendition instead of the original rendition flags.
+     */
+    quint16 withRendition(quint16 index , quint8 rendition);
+    /**
+     * Returns the index of the style which is the same as the style at @p index
+     * but with the foreground and background colors swapped.
+     */
+    quint16 reversed(quint16 index);
+
+    /**
+     * Adds a reference to the style at @p index , which prevents it from
+     * being removed from the table.
+     */
+    void ref(quint16 index);
+    /** Releases a reference added with ref() */
+    void deref(quint16 index);
+
+    /** Returns the number of styles in the table. */
+    int count() const;
+
+private:
+    // styles are stored in fixed size chunks which are never moved, so that
+    // styles can be looked up while other threads are adding to the table
+    enum
+    {
+        ChunkShift = 8,
+        ChunkSize = 1 << ChunkShift,
+        ChunkMask = ChunkSize - 1,
+        ChunkCount = 256
+    };
+
+    struct Entry
+    {
+        CharacterStyle style;
+        // index of the style with reversed colors, or NoStyle if not yet known
+        quint16 reversed;
+        // number of references added with ref(), or -1 if the entry is free
+        int refCount;
+        // the value of _requestCount when the style was last requested
+        quint32 lastRequest;
+    };
+
+    static const quint16 NoStyle = 0xFFFF;
+
+    // returns the index of the style, adding it if necessary.
+    // must be called with _lock held
+    quint16 addStyle(const CharacterStyle& style);
+    // removes the styles which are not referenced and have not been
+    // requested recently.  must be called with _lock held
+    void releaseUnusedStyles();
+    // packs the colors and rendition of a style into a key for _indexes
+    static quint64 styleKey(const CharacterStyle& style);
+    // returns the nearest color to 'color' in the 256 color palette
+    // if 'color' is an RGB color, or 'color' itself otherwise
+    static CharacterColor approximateColor(const CharacterColor& color);
+
+    Entry* _chunks[ChunkCount];
+    int _count;
+    QHash<quint64,quint16> _indexes;
+    // indexes of the removed styles, which are re-used before new ones
+    QList<quint16> _freeIndexes;
+    // number of times a style has been requested
+    quint32 _requestCount;
+    // number of requests for new styles which have been turned down
+    // since unused styles were last removed
+    int _requestsSinceRelease;
+    // number of styles whose last reference has been released since
+    // unused styles were last removed
+    int _releasedSinceRelease;
+
+    mutable QMutex _lock;
+};
+
+}
+
+#endif // CHARACTERSTYLETABLE_H
@@ -28,6 +28,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 // Qt
@@ -38,6 +39,7 @@
 #include <QtCore/QRegExp>
 #include <QtCore/QTextStream>
 #include <QtCore/QThread>
+#include <QtCore/QTimer>
 
 #include <QtCore/QTime>
 
@@ -45,10 +47,13 @@
 #include <kdebug.h>
 
 // Konsole
+#include "FrameClock.h"
 #include "KeyboardTranslator.h"
 #include "Screen.h"
+#include "Stopwatch.h"
 #include "TerminalCharacterDecoder.h"
 #include "ScreenWindow.h"
+#include "TraceRecorder.h"
 
 using namespace Konsole;
 
@@ -60,25 +65,38 @@ using namespace Konsole;
 
 //#define CNTL(c) ((c)-'@')
 
+// time in milliseconds for which the alternate screen is kept after
+// switching back to the primary screen
+static const int AlternateScreenReleaseDelay = 60 * 1000;
+
 /*!
 */
 
 Emulation::Emulation() :
+  _lock(QMutex::Recursive),
   _currentScreen(0),
   _codec(0),
   _decoder(0),
   _keyTranslator(0),
-  _usesMouse(false)
+  _escapeSequences(0),
+  _usesMouse(false),
+  _receivedBytes(0),
+  _parsedCharacters(0),
+  _receiveTime(0)
 {
 
-  // create screens with a default size
+  // create the primary screen with a default size, the alternate
+  // screen is created when it is first used
   _screen[0] = new Screen(40,80);
-  _screen[1] = new Screen(40,80);
+  _screen[1] = 0;
   _currentScreen = _screen[0];
 
-  QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()) );
-  QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()) );
-   
+  _alternateScreenReleaseTimer = new QTimer(this);
+  _alternateScreenReleaseTimer->setSingleShot(true);
+  _alternateScreenReleaseTimer->setInterval(AlternateScreenReleaseDelay);
+  connect( _alternateScreenReleaseTimer , SIGNAL(timeout()) ,
+           this , SLOT(releaseAlternateScreen()) );
+
   // listen for mouse status changes
   connect( this , SIGNAL(programUsesMouseChanged(bool)) , 
            SLOT(usesMouseChanged(bool)) );
@@ -96,12 +114,19 @@ void Emulation::usesMouseChanged(bool usesMouse)
 
 ScreenWindow* Emulation::createWindow()
 {
+    QMutexLocker locker(&_lock);
+
     ScreenWindow* window = new ScreenWindow();
     window->setScreen(_currentScreen);
+    window->setScreenLock(&_lock);
     _windows << window;
 
     connect(window , SIGNAL(selectionChanged()),
             this , SLOT(bufferedUpdate()));
+    // updates are deferred while none of the windows are visible, so
+    // catch up when one is shown
+    connect(window , SIGNAL(visibilityChanged(bool)),
+            this , SLOT(bufferedUpdate()));
 
     connect(this , SIGNAL(outputChanged()),
             window , SLOT(notifyOutputChanged()) );
@@ -131,7 +156,7 @@ Emulation::~Emulation()
 void Emulation::setScreen(int n)
 {
   Screen *old = _currentScreen;
-  _currentScreen = _screen[n&1];
+  _currentScreen = (n&1) ? alternateScreen() : _screen[0];
   if (_currentScreen != old) 
   {
      old->setBusySelecting(false);
@@ -142,15 +167,68 @@ void Emulation::setScreen(int n)
      {
          windowIter.next()->setScreen(_currentScreen);
      }
+
+     if ( _currentScreen == _screen[0] )
+         scheduleAlternateScreenRelease();
+  }
+}
+
+Screen* Emulation::alternateScreen()
+{
+  Screen* primary = _screen[0];
+
+  if ( !_screen[1] )
+  {
+     _screen[1] = new Screen(primary->getLines(),primary->getColumns());
+     initAlternateScreen(_screen[1]);
+  }
+  else if ( _screen[1]->getLines() != primary->getLines() ||
+            _screen[1]->getColumns() != primary->getColumns() )
+  {
+     // the alternate screen is not resized by setImageSize() whilst
+     // it is inactive
+     _screen[1]->resizeImage(primary->getLines(),primary->getColumns());
+     initAlternateScreen(_screen[1]);
+  }
+
+  return _screen[1];
+}
+
+void Emulation::initAlternateScreen(Screen*)
+{
+}
+
+void Emulation::scheduleAlternateScreenRelease()
+{
+   // the timer belongs to the GUI thread
+   if ( !inOwnThread() )
+   {
+       QMetaObject::invokeMethod(this,"scheduleAlternateScreenRelease",Qt::QueuedConnection);
+       return;
+   }
+
+   _alternateScreenReleaseTimer->start();
+}
+
+void Emulation::releaseAlternateScreen()
+{
+  QMutexLocker locker(&_lock);
+
+  if ( _screen[1] && _currentScreen != _screen[1] )
+  {
+     delete _screen[1];
+     _screen[1] = 0;
   }
 }
 
 void Emulation::clearHistory()
 {
+    QMutexLocker locker(&_lock);
     _screen[0]->setScroll( _screen[0]->getScroll() , false );
 }
 void Emulation::setHistory(const HistoryType& t)
 {
+  QMutexLocker locker(&_lock);
   _screen[0]->setScroll(t);
 
   showBulk();
@@ -158,11 +236,14 @@ void Emulation::setHistory(const HistoryType& t)
 
 const HistoryType& Emulation::history()
 {
+  QMutexLocker locker(&_lock);
   return _screen[0]->getScroll();
 }
 
 void Emulation::setCodec(const QTextCodec * qtc)
 {
+  QMutexLocker locker(&_lock);
+
   if (qtc)
   	_codec = qtc;
   else
@@ -170,6 +251,7 @@ void Emulation::setCodec(const QTextCodec * qtc)
 
   delete _decoder;
   _decoder = _codec->makeDecoder();
+  _utf8Decoder.reset();
 
   emit useUtf8Request(utf8());
 }
@@ -222,6 +304,14 @@ void Emulation::receiveChar(int c)
   };
 }
 
+void Emulation::receiveChars(const ushort* chars, int count)
+{
+  for (int i=0;i<count;i++)
+  {
+    receiveChar(chars[i]);
+  }
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                             Keyboard Handling                             */
@@ -262,31 +352,66 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
 TODO: Character composition from the old code.  See #96536
 */
 
+// returns true if the CAN character at 'pos' in 'text' introduces a z-modem transfer
+static inline bool isZModemIndicator(const char* text, int length, int pos)
+{
+	return (length-pos-1 > 3) && (strncmp(text+pos+1, "B00", 3) == 0);
+}
+
 void Emulation::receiveData(const char* text, int length)
 {
+	TraceSpan span("Emulation::receiveData");
+
+	QMutexLocker locker(&_lock);
+
+	Stopwatch receiveTime;
+
 	emit stateSet(NOTIFYACTIVITY);
 
-	bufferedUpdate();
-    	
-    QString unicodeText = _decoder->toUnicode(text,length);
+	_receivedBytes.fetchAndAddOrdered(length);
 
-	//send characters to terminal emulator
-	for (int i=0;i<unicodeText.length();i++)
+	//look for the z-modem indicator
+	bool zmodem = false;
+	const char* can = (const char*)memchr(text,'\030',length);
+	while (can)
 	{
-		receiveChar(unicodeText[i].unicode());
+		if (isZModemIndicator(text,length,can-text))
+		{
+			zmodem = true;
+			break;
+		}
+		can = (const char*)memchr(can+1,'\030',length-(can+1-text));
 	}
 
-	//look for z-modem indicator
-	//-- someone who understands more about z-modems that I do may be able to move
-	//this check into the above for loop?
-	for (int i=0;i<length;i++)
+	//UTF-8 is decoded into a buffer which is reused for each block, other
+	//encodings are decoded using the codec
+	if (utf8())
+	{
+		const int maxCount = Utf8Decoder::maximumOutputLength(length);
+		if (_charBuffer.size() < maxCount)
+			_charBuffer.resize(maxCount);
+
+		const int count = _utf8Decoder.decode(text,length,_charBuffer.data());
+
+		//send characters to terminal emulator
+		receiveChars(_charBuffer.constData(),count);
+		_parsedCharacters += count;
+	}
+	else
 	{
-		if (text[i] == '\030')
-    		{
-      			if ((length-i-1 > 3) && (strncmp(text+i+1, "B00", 3) == 0))
-      				emit zmodemDetected();
-    		}
+		QString unicodeText = _decoder->toUnicode(text,length);
+
+		//send characters to terminal emulator
+		receiveChars(unicodeText.utf16(),unicodeText.length());
+		_parsedCharacters += unicodeText.length();
 	}
+
+	if (zmodem)
+		emit zmodemDetected();
+
+	bufferedUpdate();
+
+	_receiveTime += receiveTime.elapsed();
 }
 
 //OLDER VERSION
@@ -383,26 +508,59 @@ void Emulation::writeToStream( TerminalCharacterDecoder* _decoder ,
                                int startLine ,
                                int endLine) 
 {
+  QMutexLocker locker(&_lock);
   _currentScreen->writeToStream(_decoder,startLine,endLine);
 }
 
+uint Emulation::receivedBytes() const
+{
+    return (int)_receivedBytes;
+}
+
+qint64 Emulation::parsedCharacters() const
+{
+    QMutexLocker locker(&_lock);
+    return _parsedCharacters;
+}
+
+qint64 Emulation::escapeSequences() const
+{
+    QMutexLocker locker(&_lock);
+    return _escapeSequences;
+}
+
+qint64 Emulation::historyLinesAdded() const
+{
+    QMutexLocker locker(&_lock);
+    qint64 lines = _screen[0]->historyLinesAdded();
+    if ( _screen[1] )
+        lines += _screen[1]->historyLinesAdded();
+    return lines;
+}
+
+qint64 Emulation::receiveTime() const
+{
+    QMutexLocker locker(&_lock);
+    return _receiveTime;
+}
+
 int Emulation::lineCount()
 {
+    QMutexLocker locker(&_lock);
+
     // sum number of lines currently on _screen plus number of lines in history
     return _currentScreen->getLines() + _currentScreen->getHistLines();
 }
 
 // Refreshing -------------------------------------------------------------- --
 
-#define BULK_TIMEOUT1 10
-#define BULK_TIMEOUT2 40
-
 /*!
 */
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    // the windows update their images in response to outputChanged(), so
+    // the lock is held until they are done and the counts have been reset
+    QMutexLocker locker(&_lock);
 
     emit outputChanged();
 
@@ -412,13 +570,35 @@ void Emulation::showBulk()
 
 void Emulation::bufferedUpdate()
 {
-   _bulkTimer1.setSingleShot(true);
-   _bulkTimer1.start(BULK_TIMEOUT1);
-   if (!_bulkTimer2.isActive())
+   // the frame clock belongs to the GUI thread
+   if ( !inOwnThread() )
    {
-      _bulkTimer2.setSingleShot(true);
-      _bulkTimer2.start(BULK_TIMEOUT2);
+       QMetaObject::invokeMethod(this,"bufferedUpdate",Qt::QueuedConnection);
+       return;
    }
+
+   FrameClock::instance()->scheduleUpdate(this);
+}
+
+bool Emulation::inOwnThread() const
+{
+    return QThread::currentThread() == thread();
+}
+
+void Emulation::sendBufferedData(const QByteArray& data)
+{
+    emit sendData(data.constData(),data.length());
+}
+
+bool Emulation::hasVisibleWindows() const
+{
+    QListIterator<ScreenWindow*> windowIter(_windows);
+    while (windowIter.hasNext())
+    {
+        if (windowIter.next()->isVisible())
+            return true;
+    }
+    return false;
 }
 
 char Emulation::getErase() const
@@ -432,8 +612,13 @@ void Emulation::setImageSize(int lines, int columns)
   Q_ASSERT( lines > 0 );
   Q_ASSERT( columns > 0 );
 
+  QMutexLocker locker(&_lock);
+
+  // the alternate screen is only resized when it is next used
+  // if it is not currently active, see alternateScreen()
   _screen[0]->resizeImage(lines,columns);
-  _screen[1]->resizeImage(lines,columns);
+  if ( _currentScreen != _screen[0] )
+      _currentScreen->resizeImage(lines,columns);
 
   emit imageSizeChanged(lines,columns);
 
@@ -442,100 +627,164 @@ void Emulation::setImageSize(int lines, int columns)
 
 QSize Emulation::imageSize()
 {
+  QMutexLocker locker(&_lock);
   return QSize(_currentScreen->getColumns(), _currentScreen->getLines());
 }
 
-ushort ExtendedCharTable::extendedCharHash(ushort* unicodePoints , ushort length) const
+const int ExtendedCharTable::MaximumSequenceLength;
+
+// the number of keys available, key 0 is never used
+static const int MaximumExtendedCharCount = 0xFFFF;
+
+uint ExtendedCharTable::extendedCharHash(const ushort* unicodePoints , ushort length)
 {
-    ushort hash = 0;
+    uint hash = 0;
     for ( ushort i = 0 ; i < length ; i++ )
     {
         hash = 31*hash + unicodePoints[i];
     }
     return hash;
 }
-bool ExtendedCharTable::extendedCharMatch(ushort hash , ushort* unicodePoints , ushort length) const
+bool ExtendedCharTable::extendedCharMatch(const Entry& entry , const ushort* unicodePoints , ushort length)
 {
-    ushort* entry = extendedCharTable[hash];
-
-    // compare given length with stored sequence length ( given as the first ushort in the 
-    // stored buffer ) 
-    if ( entry == 0 || entry[0] != length ) 
+    if ( entry.length != length )
        return false;
-    // if the lengths match, each character must be checked.  the stored buffer starts at
-    // entry[1]
+
     for ( int i = 0 ; i < length ; i++ )
     {
-        if ( entry[i+1] != unicodePoints[i] )
+        if ( entry.unicodePoints[i] != unicodePoints[i] )
            return false; 
     } 
     return true;
 }
-ushort ExtendedCharTable::createExtendedChar(ushort* unicodePoints , ushort length)
+ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushort length)
 {
-    // look for this sequence of points in the table
-    ushort hash = extendedCharHash(unicodePoints,length);
+    Q_ASSERT( length > 0 && length <= MaximumSequenceLength );
+
+    QMutexLocker locker(&_lock);
+
+    // look for this sequence of points in the chain of entries with
+    // the same hash
+    uint hash = extendedCharHash(unicodePoints,length);
+    ushort first = _buckets.value(hash,0);
 
-    // check existing entry for match
-    while ( extendedCharTable.contains(hash) )
+    for ( ushort key = first ; key != 0 ; key = _entries[key].next )
     {
-        if ( extendedCharMatch(hash,unicodePoints,length) )
-        {
-            // this sequence already has an entry in the table, 
-            // return its hash
-            return hash;
-        }
-        else
+        Entry& entry = _entries[key];
+        if ( extendedCharMatch(entry,unicodePoints,length) )
         {
-            // if hash is already used by another, different sequence of unicode character
-            // points then try next hash
-            hash++;
+            entry.refCount++;
+            return key;
         }
-    }    
+    }
 
-    
-     // add the new sequence to the table and
-     // return that index
-    ushort* buffer = new ushort[length+1];
-    buffer[0] = length;
+    // find a key for the new sequence.  unused keys are handed out before
+    // keys of removed sequences, which may still be referenced by a copy
+    // of the screen image that has not been updated yet
+    ushort key = 0;
+    if ( _entries.count() <= MaximumExtendedCharCount )
+    {
+        key = _entries.count();
+        _entries.append(Entry());
+    }
+    else if ( !_freeKeys.isEmpty() )
+    {
+        key = _freeKeys.dequeue();
+    }
+    else
+    {
+        return 0;
+    }
+
+    Entry& entry = _entries[key];
+    entry.unicodePoints = new ushort[length];
     for ( int i = 0 ; i < length ; i++ )
-       buffer[i+1] = unicodePoints[i]; 
-    
-    extendedCharTable.insert(hash,buffer);
+       entry.unicodePoints[i] = unicodePoints[i];
+    entry.length = length;
+    entry.hash = hash;
+    entry.refCount = 1;
+    entry.next = first;
 
-    return hash;
+    _buckets.insert(hash,key);
+    _count++;
+
+    return key;
 }
 
-ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
+void ExtendedCharTable::deref(ushort key)
 {
-    // lookup index in table and if found, set the length
-    // argument and return a pointer to the character sequence
+    QMutexLocker locker(&_lock);
 
-    ushort* buffer = extendedCharTable[hash];
-    if ( buffer )
+    Q_ASSERT( key > 0 && key < _entries.count() );
+    Entry& entry = _entries[key];
+    Q_ASSERT( entry.refCount > 0 );
+
+    if ( --entry.refCount > 0 )
+        return;
+
+    // unlink the entry from the chain of entries with the same hash
+    ushort first = _buckets.value(entry.hash,0);
+    if ( first == key )
     {
-        length = buffer[0];
-        return buffer+1;
+        if ( entry.next != 0 )
+            _buckets.insert(entry.hash,entry.next);
+        else
+            _buckets.remove(entry.hash);
     }
     else
     {
-        length = 0;
-        return 0;
+        ushort previous = first;
+        while ( _entries[previous].next != key )
+            previous = _entries[previous].next;
+        _entries[previous].next = entry.next;
     }
+
+    delete[] entry.unicodePoints;
+    entry.unicodePoints = 0;
+    entry.length = 0;
+    entry.next = 0;
+
+    _freeKeys.enqueue(key);
+    _count--;
+}
+
+ushort ExtendedCharTable::lookupExtendedChar(ushort key , ushort* buffer) const
+{
+    QMutexLocker locker(&_lock);
+
+    if ( key == 0 || key >= _entries.count() )
+        return 0;
+
+    const Entry& entry = _entries[key];
+    for ( int i = 0 ; i < entry.length ; i++ )
+        buffer[i] = entry.unicodePoints[i];
+
+    return entry.length;
+}
+
+int ExtendedCharTable::count() const
+{
+    QMutexLocker locker(&_lock);
+    return _count;
 }
 
 ExtendedCharTable::ExtendedCharTable()
+    : _count(0)
 {
+    // key 0 is reserved
+    Entry unused;
+    unused.unicodePoints = 0;
+    unused.length = 0;
+    unused.next = 0;
+    unused.hash = 0;
+    unused.refCount = 0;
+    _entries.append(unused);
 }
 ExtendedCharTable::~ExtendedCharTable()
 {
     // free all allocated character buffers
-    QHashIterator<ushort,ushort*> iter(extendedCharTable);
-    while ( iter.hasNext() )
-    {
-        iter.next();
-        delete[] iter.value();
-    }
+    for ( int i = 0 ; i < _entries.count() ; i++ )
+        delete[] _entries[i].unicodePoints;
 }
 
 // global instance
@@ -29,10 +29,16 @@
 // Qt 
 #include <QtGui/QKeyEvent>
 //#include <QPointer>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
-#include <QtCore/QTimer>
+#include <QtCore/QVector>
 
+// Konsole
+#include "Utf8Decoder.h"
+
+class QTimer;
 
 namespace Konsole
 {
@@ -142,6 +148,29 @@ public:
    */ 
   int lineCount();
 
+  /** 
+   * Returns the total number of bytes which have been passed to receiveData()
+   * since the emulation was created, modulo 2^32.  Only the difference between
+   * two values is meaningful.
+   *
+   * The count is updated atomically, so this does not wait for the emulation
+   * to finish processing the data which it is currently receiving.
+   */
+  uint receivedBytes() const;
+  /**
+   * Returns the total number of characters which have been decoded
+   * from the data passed to receiveData() and processed.
+   */
+  qint64 parsedCharacters() const;
+  /** Returns the total number of escape sequences which have been processed. */
+  qint64 escapeSequences() const;
+  /** 
+   * Returns the total number of lines which have been moved from the screens
+   * into the history.
+   */
+  qint64 historyLinesAdded() const;
+  /** Returns the total time spent in receiveData(), in microseconds. */
+  qint64 receiveTime() const;
   
   /** 
    * Sets the history store used by this emulation.  When new lines
@@ -249,12 +278,18 @@ public slots:
 
   /** 
    * Processes an incoming stream of characters.  receiveData() decodes the incoming
-   * character buffer using the current codec(), and then calls receiveChar() for
-   * each unicode character in the resulting buffer.  
+   * character buffer using the current codec(), and then passes the resulting 
+   * unicode characters to receiveChars().  
+   *
+   * receiveData() also schedules an update with the FrameClock, which causes the
+   * outputChanged() signal to be emitted on the next frame.  This allows multiple
+   * updates in quick succession to be buffered into a single outputChanged()
+   * signal emission.
    *
-   * receiveData() also starts a timer which causes the outputChanged() signal
-   * to be emitted when it expires.  The timer allows multiple updates in quick
-   * succession to be buffered into a single outputChanged() signal emission.
+   * receiveData() may be called from a thread other than the one the emulation
+   * belongs to ( see EmulationThreadPool ).  The emulation's lock is held while
+   * the data is processed and signals emitted whilst processing are delivered to
+   * the emulation's thread.
    *
    * @param buffer A string of characters received from the terminal program.
    * @param len The length of @p buffer
@@ -280,6 +315,9 @@ signals:
    * input from the terminal process' stdout be 
    * suspended.  Otherwise requests that sending of
    * input be resumed. 
+   *
+   * This is emitted by EmulationThreadPool when the emulation
+   * falls too far behind the output from the terminal.
    */
   void lockPtyRequest(bool suspend);
 
@@ -399,6 +437,18 @@ protected:
    */
   virtual void receiveChar(int ch);
 
+  /**
+   * Processes a block of incoming characters.  See receiveData()
+   *
+   * The default implementation calls receiveChar() for each character in turn.
+   * Emulations can reimplement this to handle runs of printable characters 
+   * more efficiently.
+   *
+   * @p chars An array of unicode character codes
+   * @p count The number of characters in @p chars
+   */
+  virtual void receiveChars(const ushort* chars, int count);
+
   /** 
    * Sets the active screen.  The terminal has two screens, primary and alternate.
    * The primary screen is used by default.  When certain interactive programs such
@@ -408,6 +458,24 @@ protected:
    */
   void setScreen(int index); 
 
+  /**
+   * Returns the alternate screen.  The alternate screen is not created until
+   * it is first needed and it is not resized whilst it is inactive, so this
+   * creates the screen or brings its size up to date with the primary screen
+   * if necessary.  Once the primary screen has been active again for a while
+   * the alternate screen is deleted.
+   */
+  Screen* alternateScreen();
+
+  /**
+   * Called when the alternate screen is created or resized by alternateScreen().
+   * Emulations which apply some modes or settings to both screens should
+   * re-implement this to apply them to @p screen.
+   *
+   * The default implementation does nothing.
+   */
+  virtual void initAlternateScreen(Screen* screen);
+
   enum EmulationCodec
   {
       LocaleCodec = 0,
@@ -415,6 +483,15 @@ protected:
   };
   void setCodec(EmulationCodec codec); // codec number, 0 = locale, 1=utf8
 
+  // returns true if called from the thread which the emulation belongs to,
+  // as opposed to an EmulationThreadPool thread
+  bool inOwnThread() const;
+
+  // held while the emulation's state or screens are being read or changed.
+  // this is recursive because many of the public methods call each other
+  // and receiveData() calls several of them whilst processing the data
+  mutable QMutex _lock;
+
 
   QList<ScreenWindow*> _windows;
   
@@ -425,15 +502,25 @@ protected:
                             //                      scrollbars are enabled in this mode )
                             // 1 = alternate      ( used by vi , emacs etc.
                             //                      scrollbars are not enabled in this mode )
+                            //                      this is 0 until the alternate screen is used,
+                            //                      see alternateScreen()
                             
   
   //decodes an incoming C-style character stream into a unicode QString using 
   //the current text codec.  (this allows for rendering of non-ASCII characters in text files etc.)
   const QTextCodec* _codec;
   QTextDecoder* _decoder;
+  // used instead of _decoder when the codec is UTF-8
+  Utf8Decoder _utf8Decoder;
+  // buffer for the unicode characters passed to receiveChars(), 
+  // reused for each block of data
+  QVector<ushort> _charBuffer;
 
   const KeyboardTranslator* _keyTranslator; // the keyboard layout
 
+  // see escapeSequences(), this is updated by sub-classes
+  qint64 _escapeSequences;
+
 protected slots:
   /** 
    * Schedules an update of attached views.
@@ -442,20 +529,39 @@ protected slots:
    */
   void bufferedUpdate();
 
+  /** 
+   * Emits sendData() with the contents of @p data.  This is used to send replies
+   * generated whilst processing data on another thread.  See sendString()
+   */
+  void sendBufferedData(const QByteArray& data);
+
 private slots: 
 
-  // triggered by timer, causes the emulation to send an updated screen image to each
-  // view
+  // called by the FrameClock, causes the emulation to send an updated screen
+  // image to each view
   void showBulk(); 
 
   void usesMouseChanged(bool usesMouse);
 
+  // starts the timer which deletes the alternate screen if it remains inactive
+  void scheduleAlternateScreenRelease();
+  // deletes the alternate screen if it is not the active screen
+  void releaseAlternateScreen();
+
 private:
 
+  friend class FrameClock;
+
+  // returns true if any of the windows created with createWindow() are visible
+  bool hasVisibleWindows() const;
+
   bool _usesMouse;
-  QTimer _bulkTimer1;
-  QTimer _bulkTimer2;
-  
+  QAtomicInt _receivedBytes;
+  qint64 _parsedCharacters;
+  qint64 _receiveTime;
+
+  QTimer* _alternateScreenReleaseTimer;
+
 };
 
 }
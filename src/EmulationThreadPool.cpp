@@ -0,0 +1,236 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "EmulationThreadPool.h"
+
+// Qt
+#include <QtCore/QThread>
+
+// KDE
+#include <kglobal.h>
+
+// Konsole
+#include "Emulation.h"
+
+using namespace Konsole;
+
+// maximum number of worker threads.  one thread is left for the GUI.
+static const int MaximumThreadCount = 4;
+
+// maximum amount of data passed to an emulation at once.  the emulation's
+// screens are locked whilst a slice is processed, so this limits how long the
+// GUI thread can be kept waiting when it takes a snapshot of the screen
+static const int MaximumSliceSize = 16 * 1024;
+
+// amount of data waiting to be processed by an emulation above which reading
+// from the terminal is suspended, and below which it is resumed again
+static const int SuspendThreshold = 256 * 1024;
+static const int ResumeThreshold = 64 * 1024;
+
+class EmulationThreadPool::WorkerThread : public QThread
+{
+public:
+    WorkerThread(EmulationThreadPool* pool) : _pool(pool) {}
+
+protected:
+    virtual void run() { _pool->processJobs(); }
+
+private:
+    EmulationThreadPool* _pool;
+};
+
+EmulationThreadPool::EmulationThreadPool()
+    : _focusedEmulation(0)
+    , _quit(false)
+{
+    const int count = qMin( QThread::idealThreadCount() - 1 , MaximumThreadCount );
+
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        QThread* thread = new WorkerThread(this);
+        thread->start();
+        _threads << thread;
+    }
+}
+
+EmulationThreadPool::~EmulationThreadPool()
+{
+    _mutex.lock();
+    _quit = true;
+    _jobAvailable.wakeAll();
+    _mutex.unlock();
+
+    QListIterator<QThread*> iter(_threads);
+    while ( iter.hasNext() )
+    {
+        QThread* thread = iter.next();
+        thread->wait();
+        delete thread;
+    }
+}
+
+K_GLOBAL_STATIC( EmulationThreadPool , theEmulationThreadPool )
+EmulationThreadPool* EmulationThreadPool::instance()
+{
+    return theEmulationThreadPool;
+}
+
+int EmulationThreadPool::threadCount() const
+{
+    return _threads.count();
+}
+
+void EmulationThreadPool::receiveData(Emulation* emulation , const char* data , int length)
+{
+    QMutexLocker locker(&_mutex);
+
+    if ( _threads.isEmpty() )
+    {
+        _jobs[emulation].queuedBytes += length;
+        locker.unlock();
+
+        emulation->receiveData(data,length);
+
+        locker.relock();
+        _jobs[emulation].processedBytes += length;
+        return;
+    }
+
+    Job& job = _jobs[emulation];
+    const bool idle = job.data.isEmpty() && !job.running;
+    job.data.append( QByteArray(data,length) );
+    job.queuedBytes += length;
+
+    // if the emulation is already queued or being processed, the new data will
+    // be picked up along with the data already waiting
+    if ( idle )
+    {
+        _queue << emulation;
+        _jobAvailable.wakeOne();
+    }
+
+    if ( job.data.size() > SuspendThreshold && !job.suspended )
+        setTerminalSuspended(emulation,job,true);
+}
+
+void EmulationThreadPool::setTerminalSuspended(Emulation* emulation , Job& job , bool suspended)
+{
+    job.suspended = suspended;
+
+    // this is called from both the GUI and worker threads, so use a queued call
+    // which is delivered to the terminal in the GUI thread.  requests are delivered
+    // in the order in which they were made
+    QMetaObject::invokeMethod(emulation,"lockPtyRequest",Qt::QueuedConnection,
+                              Q_ARG(bool,suspended));
+}
+
+qint64 EmulationThreadPool::queuedBytes(Emulation* emulation) const
+{
+    QMutexLocker locker(&_mutex);
+    return _jobs.value(emulation).queuedBytes;
+}
+
+qint64 EmulationThreadPool::processedBytes(Emulation* emulation) const
+{
+    QMutexLocker locker(&_mutex);
+    return _jobs.value(emulation).processedBytes;
+}
+
+void EmulationThreadPool::setFocusedEmulation(Emulation* emulation)
+{
+    QMutexLocker locker(&_mutex);
+    _focusedEmulation = emulation;
+}
+
+void EmulationThreadPool::removeEmulation(Emulation* emulation)
+{
+    QMutexLocker locker(&_mutex);
+
+    _queue.removeAll(emulation);
+
+    while ( _jobs.contains(emulation) && _jobs[emulation].running )
+        _jobFinished.wait(&_mutex);
+
+    _jobs.remove(emulation);
+
+    if ( _focusedEmulation == emulation )
+        _focusedEmulation = 0;
+}
+
+Emulation* EmulationThreadPool::takeNextEmulation()
+{
+    if ( _focusedEmulation && _queue.removeAll(_focusedEmulation) > 0 )
+        return _focusedEmulation;
+
+    return _queue.takeFirst();
+}
+
+void EmulationThreadPool::processJobs()
+{
+    QMutexLocker locker(&_mutex);
+
+    while ( !_quit )
+    {
+        if ( _queue.isEmpty() )
+        {
+            _jobAvailable.wait(&_mutex);
+            continue;
+        }
+
+        Emulation* emulation = takeNextEmulation();
+
+        Job& job = _jobs[emulation];
+        job.running = true;
+
+        QByteArray slice;
+        if ( job.data.size() <= MaximumSliceSize )
+        {
+            slice = job.data;
+            job.data.clear();
+        }
+        else
+        {
+            slice = job.data.left(MaximumSliceSize);
+            job.data.remove(0,MaximumSliceSize);
+        }
+
+        locker.unlock();
+        emulation->receiveData(slice.constData(),slice.size());
+        locker.relock();
+
+        // the job may have been moved in memory if other emulations were
+        // added to the hash in the meantime
+        Job& finishedJob = _jobs[emulation];
+        finishedJob.running = false;
+        finishedJob.processedBytes += slice.size();
+
+        // emulations with more data waiting go to the back of the queue so that
+        // each one gets a fair share of the threads
+        if ( !finishedJob.data.isEmpty() )
+            _queue << emulation;
+
+        if ( finishedJob.suspended && finishedJob.data.size() < ResumeThreshold )
+            setTerminalSuspended(emulation,finishedJob,false);
+
+        _jobFinished.wakeAll();
+    }
+}
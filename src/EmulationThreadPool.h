@@ -0,0 +1,156 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef EMULATIONTHREADPOOL_H
+#define EMULATIONTHREADPOOL_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+class QThread;
+
+namespace Konsole
+{
+
+class Emulation;
+
+/**
+ * Processes the output from terminal programs on a small pool of worker threads,
+ * so that a session which is producing a lot of output does not stall typing and
+ * painting in other sessions.
+ *
+ * Data received from a terminal is passed to receiveData(), which queues it
+ * for the emulation.  A worker thread then passes the queued data to
+ * Emulation::receiveData() in slices.  Each emulation is processed by only one
+ * thread at a time, so the data is always processed in the order in which it
+ * was received.  After each slice, the next emulation with queued data is chosen,
+ * with the focused emulation ( see setFocusedEmulation() ) taking priority
+ * over the others.
+ *
+ * If too much data is waiting to be processed for an emulation, the emulation's
+ * lockPtyRequest() signal is emitted to stop reading output from the terminal until
+ * the emulation has caught up.  This keeps the amount of memory used by the queue
+ * bounded and causes the terminal program to block when it produces output faster
+ * than it can be processed.
+ *
+ * Whilst a slice is being processed, the emulation's screens are locked.  The views
+ * take their snapshot of the screen through ScreenWindow, which takes the same lock.
+ *
+ * On systems with a single processor, no worker threads are created and
+ * receiveData() processes the data immediately.
+ */
+class EmulationThreadPool
+{
+public:
+    /** Constructs a new pool and starts its worker threads. */
+    EmulationThreadPool();
+    /** Stops the worker threads. */
+    ~EmulationThreadPool();
+
+    /** Returns the application-wide pool. */
+    static EmulationThreadPool* instance();
+
+    /**
+     * Queues @p length bytes from @p data to be processed by @p emulation.
+     * The data is copied, so @p data does not need to remain valid after
+     * this call.
+     */
+    void receiveData(Emulation* emulation , const char* data , int length);
+
+    /**
+     * Sets the emulation whose output is processed before that of other
+     * emulations.  This should be the emulation of the session which the user
+     * is currently interacting with.
+     */
+    void setFocusedEmulation(Emulation* emulation);
+
+    /**
+     * Discards any queued data for @p emulation and waits until it is no longer
+     * being processed by a worker thread.  This must be called before an emulation
+     * which has been passed to receiveData() is deleted.
+     */
+    void removeEmulation(Emulation* emulation);
+
+    /** Returns the number of worker threads in the pool. */
+    int threadCount() const;
+
+    /** 
+     * Returns the total number of bytes which have been passed to receiveData()
+     * for @p emulation.
+     */
+    qint64 queuedBytes(Emulation* emulation) const;
+    /**
+     * Returns the total number of bytes passed to receiveData() for @p emulation
+     * which the emulation has finished processing.  Data is processed in the order
+     * in which it was received, so once this reaches the value which queuedBytes()
+     * returned at some earlier point, all the data queued up to then has been processed.
+     */
+    qint64 processedBytes(Emulation* emulation) const;
+
+private:
+    class WorkerThread;
+    friend class WorkerThread;
+
+    // data waiting to be processed by an emulation
+    class Job
+    {
+    public:
+        Job() : running(false) , suspended(false) , queuedBytes(0) , processedBytes(0) {}
+
+        QByteArray data;
+        // true whilst a worker thread is processing data for the emulation
+        bool running;
+        // true if reading from the terminal has been suspended
+        // because too much data is waiting
+        bool suspended;
+        // see EmulationThreadPool::queuedBytes() , processedBytes()
+        qint64 queuedBytes;
+        qint64 processedBytes;
+    };
+
+    // main loop of the worker threads
+    void processJobs();
+    // removes and returns the next emulation to process from the queue,
+    // called with _mutex held
+    Emulation* takeNextEmulation();
+    // requests that reading from the emulation's terminal be suspended or resumed
+    void setTerminalSuspended(Emulation* emulation , Job& job , bool suspended);
+
+    QList<QThread*> _threads;
+
+    mutable QMutex _mutex;
+    QWaitCondition _jobAvailable;
+    QWaitCondition _jobFinished;
+    QHash<Emulation*,Job> _jobs;
+    // emulations which have data to process and are not currently being processed,
+    // in the order in which they were queued
+    QList<Emulation*> _queue;
+    Emulation* _focusedEmulation;
+    bool _quit;
+};
+
+}
+
+#endif // EMULATIONTHREADPOOL_H
@@ -38,6 +38,7 @@
 
 // Konsole
 #include "TerminalCharacterDecoder.h"
+#include "TraceRecorder.h"
 
 using namespace Konsole;
 
@@ -79,6 +80,8 @@ void FilterChain::setBuffer(const QString* buffer , const QList<int>* linePositi
 }
 void FilterChain::process()
 {
+    TraceSpan span("FilterChain::process");
+
     QListIterator<Filter*> iter(*this);
     while (iter.hasNext())
         iter.next()->process();
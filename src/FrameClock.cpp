@@ -0,0 +1,250 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FrameClock.h"
+
+// Qt
+#include <QtCore/QTimer>
+
+// KDE
+#include <kglobal.h>
+
+// Konsole
+#include "Emulation.h"
+
+using namespace Konsole;
+
+static const int DefaultRefreshRate = 60;
+
+// delay before the first frame after the clock has been idle.  this allows the rest
+// of a burst of output to arrive before the views are updated, without a
+// noticeable delay in echoing keystrokes
+static const int FirstFrameDelay = 2;
+
+// the longest interval between frames, however long painting takes
+static const int MaximumInterval = 100;
+
+// number of consecutive frames with new output after which the output is
+// treated as a continuous stream and the frame rate is halved
+static const int BusyFrameThreshold = 30;
+
+// input rate, in bytes per second, above which the output of an emulation is
+// considered to be a flood
+static const int JumpScrollThreshold = 1024 * 1024;
+// number of consecutive frames for which output must arrive above the
+// threshold rate before jump scrolling starts.  this prevents short bursts
+// of output ( such as a full-screen program redrawing ) from being jump scrolled
+static const int JumpScrollFrames = 10;
+// interval between updates of views while jump scrolling
+static const int JumpScrollInterval = 200;
+
+FrameClock::FrameClock()
+    : _jumpScrollEnabled(true)
+    , _refreshRate(DefaultRefreshRate)
+    , _interval(1000 / DefaultRefreshRate)
+    , _averageUpdateTime(0)
+    , _averagePaintTime(0)
+    , _busyFrames(0)
+{
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    connect( _timer , SIGNAL(timeout()) , this , SLOT(tick()) );
+}
+
+K_GLOBAL_STATIC( FrameClock , theFrameClock )
+FrameClock* FrameClock::instance()
+{
+    return theFrameClock;
+}
+
+void FrameClock::setRefreshRate(int framesPerSecond)
+{
+    Q_ASSERT( framesPerSecond > 0 );
+
+    _refreshRate = framesPerSecond;
+    updateInterval();
+}
+int FrameClock::refreshRate() const
+{
+    return _refreshRate;
+}
+int FrameClock::interval() const
+{
+    return _interval;
+}
+void FrameClock::setJumpScrollEnabled(bool enabled)
+{
+    _jumpScrollEnabled = enabled;
+}
+bool FrameClock::jumpScrollEnabled() const
+{
+    return _jumpScrollEnabled;
+}
+bool FrameClock::isJumpScrolling(Emulation* emulation) const
+{
+    return _jumpScrollEnabled &&
+           _emulations.value(emulation).floodFrames >= JumpScrollFrames;
+}
+
+void FrameClock::scheduleUpdate(Emulation* emulation)
+{
+    if ( !_emulations.contains(emulation) )
+    {
+        connect( emulation , SIGNAL(destroyed(QObject*)) , this ,
+                 SLOT(emulationDestroyed(QObject*)) );
+    }
+
+    _emulations[emulation].pending = true;
+
+    if ( !_timer->isActive() && emulation->hasVisibleWindows() )
+        startTimer();
+}
+
+void FrameClock::emulationDestroyed(QObject* emulation)
+{
+    _emulations.remove( static_cast<Emulation*>(emulation) );
+}
+
+void FrameClock::addPaintTime(int msecs)
+{
+    // running average, weighted towards recent frames
+    _averagePaintTime = (_averagePaintTime * 3 + msecs) / 4;
+    updateInterval();
+}
+
+void FrameClock::updateInterval()
+{
+    int interval = 1000 / _refreshRate;
+
+    // keep the time spent updating and painting views to roughly half of
+    // each frame, so that the rest is left for processing the output
+    interval = qMax( interval , 2 * (_averageUpdateTime + _averagePaintTime) );
+
+    // when output is arriving continuously, it is scrolling too fast to read and
+    // updating the views less often leaves more time for processing it
+    if ( _busyFrames > BusyFrameThreshold )
+        interval *= 2;
+
+    _interval = qMin( interval , MaximumInterval );
+}
+
+void FrameClock::startTimer()
+{
+    const int sinceLastFrame = _lastFrameTime.isValid() ? _lastFrameTime.elapsed() : MaximumInterval;
+
+    // QTime::elapsed() wraps around at midnight
+    if ( sinceLastFrame >= _interval || sinceLastFrame < 0 )
+    {
+        // the clock has been idle, so this is the start of new output
+        _busyFrames = 0;
+        updateInterval();
+        _timer->start(FirstFrameDelay);
+    }
+    else
+    {
+        _timer->start(_interval - sinceLastFrame);
+    }
+}
+
+bool FrameClock::hasVisibleChanges() const
+{
+    QHashIterator<Emulation*,EmulationState> iter(_emulations);
+    while ( iter.hasNext() )
+    {
+        iter.next();
+        if ( iter.value().pending && iter.key()->hasVisibleWindows() )
+            return true;
+    }
+    return false;
+}
+
+bool FrameClock::isUpdateDue(Emulation* emulation , EmulationState& state)
+{
+    // measure the rate at which output has arrived since the last frame
+    const int elapsed = state.measureTime.isValid() ? state.measureTime.restart() : 0;
+    const uint receivedBytes = emulation->receivedBytes();
+    const qint64 received = receivedBytes - state.measuredBytes;
+    state.measuredBytes = receivedBytes;
+
+    if ( !state.measureTime.isValid() )
+        state.measureTime.start();
+
+    if ( _jumpScrollEnabled && elapsed > 0 && received * 1000 / elapsed >= JumpScrollThreshold )
+        state.floodFrames++;
+    else
+        state.floodFrames = 0;
+
+    // whilst jump scrolling, keep processing output at full speed but only update
+    // the views occasionally.  once the flood ends, the rate drops below the
+    // threshold and the views are updated on the next frame
+    if ( state.floodFrames >= JumpScrollFrames && state.lastUpdateTime.isValid() )
+    {
+        const int sinceLastUpdate = state.lastUpdateTime.elapsed();
+        if ( sinceLastUpdate >= 0 && sinceLastUpdate < JumpScrollInterval )
+            return false;
+    }
+
+    state.lastUpdateTime.start();
+    return true;
+}
+
+void FrameClock::tick()
+{
+    QTime updateTime;
+    updateTime.start();
+    _lastFrameTime.start();
+
+    // updates for emulations without any visible views are deferred until
+    // one of their views is shown
+    QList<Emulation*> readyEmulations;
+    QMutableHashIterator<Emulation*,EmulationState> iter(_emulations);
+    while ( iter.hasNext() )
+    {
+        iter.next();
+        EmulationState& state = iter.value();
+        if ( state.pending && iter.key()->hasVisibleWindows() &&
+             isUpdateDue(iter.key(),state) )
+        {
+            state.pending = false;
+            readyEmulations << iter.key();
+        }
+    }
+
+    QListIterator<Emulation*> readyIter(readyEmulations);
+    while ( readyIter.hasNext() )
+        readyIter.next()->showBulk();
+
+    if ( readyEmulations.isEmpty() )
+        _busyFrames = 0;
+    else
+        _busyFrames++;
+
+    _averageUpdateTime = (_averageUpdateTime * 3 + updateTime.elapsed()) / 4;
+    updateInterval();
+
+    // keep running only while there are visible changes still to be shown,
+    // for example if new output arrived while the views were being updated
+    if ( hasVisibleChanges() )
+        _timer->start(_interval);
+}
+
+#include "FrameClock.moc"
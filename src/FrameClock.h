@@ -0,0 +1,154 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef FRAMECLOCK_H
+#define FRAMECLOCK_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QTime>
+
+class QTimer;
+
+namespace Konsole
+{
+
+class Emulation;
+
+/**
+ * Schedules updates of the views attached to all terminal emulations
+ * in the application.
+ *
+ * When an emulation's output changes, it calls scheduleUpdate() instead of
+ * updating its views straight away.  All the emulations with pending changes
+ * are then updated together on the next frame.  The clock only runs while
+ * an emulation with a visible view has pending changes and is otherwise idle.
+ *
+ * Frames are normally produced at the refreshRate().  The interval between
+ * frames is lengthened if updating and painting the views takes a large
+ * proportion of each frame, or if the output is a continuous stream
+ * ( such as a large file being printed to the terminal ) which is too fast
+ * for the user to follow anyway.
+ *
+ * If an emulation receives a flood of output, the clock switches that emulation
+ * to jump scrolling.  The output is still processed at full speed but
+ * the emulation's views are only updated a few times a second until the flood
+ * ends, which avoids spending most of the time drawing frames which are
+ * immediately replaced.  See setJumpScrollEnabled()
+ */
+class FrameClock : public QObject
+{
+Q_OBJECT
+
+public:
+    /** Constructs a new frame clock.  Use instance() to get the application-wide clock. */
+    FrameClock();
+
+    /** Returns the application-wide frame clock. */
+    static FrameClock* instance();
+
+    /**
+     * Requests that @p emulation's views be updated on the next frame.
+     * Repeated requests before the next frame result in only a single update.
+     *
+     * If none of the emulation's views are visible, the update is deferred
+     * until one of them becomes visible.
+     */
+    void scheduleUpdate(Emulation* emulation);
+
+    /**
+     * Records the time taken by a view to paint itself, in milliseconds.
+     * This is used to adjust the interval between frames.
+     */
+    void addPaintTime(int msecs);
+
+    /**
+     * Sets the rate, in frames per second, at which updates are produced
+     * when the output is changing.  This should normally match the refresh rate
+     * of the display.  The default is 60.
+     */
+    void setRefreshRate(int framesPerSecond);
+    /** Returns the rate at which updates are produced.  See setRefreshRate() */
+    int refreshRate() const;
+
+    /** Returns the current interval between frames in milliseconds. */
+    int interval() const;
+
+    /**
+     * Sets whether views of emulations which are receiving a flood of output
+     * are updated at a reduced rate until the flood ends.
+     * Jump scrolling is enabled by default.
+     */
+    void setJumpScrollEnabled(bool enabled);
+    /** Returns true if jump scrolling is enabled.  See setJumpScrollEnabled() */
+    bool jumpScrollEnabled() const;
+
+    /** Returns true if @p emulation is currently being jump scrolled. */
+    bool isJumpScrolling(Emulation* emulation) const;
+
+private slots:
+    void tick();
+    void emulationDestroyed(QObject* emulation);
+
+private:
+    // update state for each emulation which has requested an update
+    class EmulationState
+    {
+    public:
+        EmulationState() : pending(false) , measuredBytes(0) , floodFrames(0) {}
+
+        // true if an update has been requested and not yet made
+        bool pending;
+        // the emulation's receivedBytes() when the input rate was last measured
+        uint measuredBytes;
+        QTime measureTime;
+        // number of consecutive frames in which output arrived faster than
+        // the jump scrolling threshold
+        int floodFrames;
+        QTime lastUpdateTime;
+    };
+
+    void startTimer();
+    void updateInterval();
+    bool hasVisibleChanges() const;
+    bool isUpdateDue(Emulation* emulation , EmulationState& state);
+
+    QTimer* _timer;
+    QHash<Emulation*,EmulationState> _emulations;
+    bool _jumpScrollEnabled;
+
+    int _refreshRate;
+    int _interval;
+
+    // time since the last frame
+    QTime _lastFrameTime;
+    // running averages of the time taken to update views
+    // and to paint them, in milliseconds
+    int _averageUpdateTime;
+    int _averagePaintTime;
+    // number of consecutive frames in which the output changed
+    int _busyFrames;
+};
+
+}
+
+#endif // FRAMECLOCK_H
@@ -31,8 +31,14 @@
 #include <unistd.h>
 #include <errno.h>
 
+// Qt
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
 // KDE
 #include <kdebug.h>
+#include <kglobal.h>
 
 // Reasonable line size
 #define LINE_SIZE	1024
@@ -83,10 +89,20 @@ FIXME: There is noticeable decrease in speed, also. Perhaps,
   A Row(X) data type which allows adding elements to the end.
 */
 
+// size of the buffer which added data is collected in before
+// it is written to the file
+static const int WriteBufferSize = 64 * 1024;
+// size of the segments of the file which are mapped for reading,
+// this must be a multiple of the page size
+static const int SegmentSize = 256 * 1024;
+// maximum number of segments of each file which are mapped at once
+static const int MaxMappedSegments = 16;
+
 HistoryFile::HistoryFile()
   : ion(-1),
-    length(0),
-	fileMap(0)
+    fileLength(0),
+    writeBuffer(0),
+    writeBufferLength(0)
 {
   if (tmpFile.open())
   { 
@@ -97,84 +113,121 @@ HistoryFile::HistoryFile()
 
 HistoryFile::~HistoryFile()
 {
-	if (fileMap)
-		unmap();
+  foreach( const Segment& mapped , segments )
+    munmap( mapped.data , SegmentSize );
+
+  delete[] writeBuffer;
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
+const char* HistoryFile::segment(qint64 index)
 {
-	assert( fileMap == 0 );
-
-	fileMap = (char*)mmap( 0 , length , PROT_READ , MAP_PRIVATE , ion , 0 );
-
-    //if mmap'ing fails, fall back to the read-lseek combination
-    if ( fileMap == MAP_FAILED )
+  for ( int i = 0 ; i < segments.count() ; i++ )
+  {
+    if ( segments[i].index == index )
     {
-            readWriteBalance = 0; 
-            fileMap = 0;
-            kDebug() << k_funcinfo << ": mmap'ing history failed.  errno = " << errno;
+      if ( i > 0 )
+        segments.prepend( segments.takeAt(i) );
+      return segments.first().data;
     }
+  }
+
+  // the segment may extend beyond the end of the file, that part of it
+  // is not read until the data has been written to the file
+  char* data = (char*)mmap( 0 , SegmentSize , PROT_READ , MAP_SHARED , ion , index * SegmentSize );
+
+  //if mmap'ing fails, fall back to reading from the file
+  if ( data == MAP_FAILED )
+  {
+    kDebug() << k_funcinfo << ": mmap'ing history failed.  errno = " << errno;
+    return 0;
+  }
+
+  if ( segments.count() == MaxMappedSegments )
+    munmap( segments.takeLast().data , SegmentSize );
+
+  Segment mapped;
+  mapped.index = index;
+  mapped.data = data;
+  segments.prepend(mapped);
+
+  return data;
 }
 
-void HistoryFile::unmap()
+void HistoryFile::write(const char* bytes, int len)
 {
-	int result = munmap( fileMap , length );
-	assert( result == 0 );
+  if (lseek(ion,fileLength,SEEK_SET) < 0) { perror("HistoryFile::add.seek"); return; }
 
-	fileMap = 0;
+  while ( len > 0 )
+  {
+    int rc = ::write(ion,bytes,len); if (rc < 0) { perror("HistoryFile::add.write"); return; }
+    fileLength += rc;
+    bytes += rc;
+    len -= rc;
+  }
 }
 
-bool HistoryFile::isMapped()
+void HistoryFile::flush()
 {
-	return (fileMap != 0);
+  write(writeBuffer,writeBufferLength);
+  writeBufferLength = 0;
 }
 
 void HistoryFile::add(const unsigned char* bytes, int len)
 {
-  if ( fileMap )
-		  unmap();
-		
-  readWriteBalance++;
+  if ( writeBufferLength + len > WriteBufferSize )
+    flush();
+
+  if ( len > WriteBufferSize )
+  {
+    write((const char*)bytes,len);
+    return;
+  }
 
-  int rc = 0;
+  if ( !writeBuffer )
+    writeBuffer = new char[WriteBufferSize];
 
-  rc = lseek(ion,length,SEEK_SET); if (rc < 0) { perror("HistoryFile::add.seek"); return; }
-  rc = write(ion,bytes,len);       if (rc < 0) { perror("HistoryFile::add.write"); return; }
-  length += rc;
+  memcpy(writeBuffer + writeBufferLength, bytes, len);
+  writeBufferLength += len;
 }
 
-void HistoryFile::get(unsigned char* bytes, int len, int loc)
+void HistoryFile::get(unsigned char* bytes, int len, qint64 loc)
 {
-  //count number of get() calls vs. number of add() calls.  
-  //If there are many more get() calls compared with add() 
-  //calls (decided by using MAP_THRESHOLD) then mmap the log
-  //file to improve performance.
-  readWriteBalance--;
-  if ( !fileMap && readWriteBalance < MAP_THRESHOLD )
-		  map();
-
-  if ( fileMap )
+  if (loc < 0 || len < 0 || loc + len > this->len())
   {
-	for (int i=0;i<len;i++)
-			bytes[i]=fileMap[loc+i];
+    fprintf(stderr,"getHist(...,%d,%lld): invalid args.\n",len,loc);
+    return;
   }
-  else
-  {	
-  	int rc = 0;
 
-  	if (loc < 0 || len < 0 || loc + len > length)
-    	fprintf(stderr,"getHist(...,%d,%d): invalid args.\n",len,loc);
-  	rc = lseek(ion,loc,SEEK_SET); if (rc < 0) { perror("HistoryFile::get.seek"); return; }
-  	rc = read(ion,bytes,len);     if (rc < 0) { perror("HistoryFile::get.read"); return; }
+  // read the part which has been written to the file
+  while ( len > 0 && loc < fileLength )
+  {
+    const int offset = loc % SegmentSize;
+    const int count = (int)qMin( (qint64)qMin(len,SegmentSize - offset) , fileLength - loc );
+    const char* data = segment(loc / SegmentSize);
+
+    if ( data )
+    {
+      memcpy(bytes, data + offset, count);
+    }
+    else
+    {
+      if (lseek(ion,loc,SEEK_SET) < 0) { perror("HistoryFile::get.seek"); return; }
+      if (read(ion,bytes,count) < 0)   { perror("HistoryFile::get.read"); return; }
+    }
+
+    bytes += count;
+    loc += count;
+    len -= count;
   }
+
+  // and the rest from the write buffer
+  if ( len > 0 )
+    memcpy(bytes, writeBuffer + (loc - fileLength), len);
 }
 
-int HistoryFile::len()
+qint64 HistoryFile::len()
 {
-  return length;
+  return fileLength + writeBufferLength;
 }
 
 
@@ -221,7 +274,7 @@ HistoryScrollFile::~HistoryScrollFile()
  
 int HistoryScrollFile::getLines()
 {
-  return index.len() / sizeof(int);
+  return index.len() / sizeof(qint64);
 }
 
 int HistoryScrollFile::getLineLen(int lineno)
@@ -231,7 +284,7 @@ int HistoryScrollFile::getLineLen(int lineno)
 
 bool HistoryScrollFile::isWrappedLine(int lineno)
 {
-  if (lineno>=0 && lineno <= getLines()) {
+  if (lineno>=0 && lineno < getLines()) {
     unsigned char flag;
     lineflags.get((unsigned char*)&flag,sizeof(unsigned char),(lineno)*sizeof(unsigned char));
     return flag;
@@ -239,17 +292,13 @@ bool HistoryScrollFile::isWrappedLine(int lineno)
   return false;
 }
 
-int HistoryScrollFile::startOfLine(int lineno)
+qint64 HistoryScrollFile::startOfLine(int lineno)
 {
   if (lineno <= 0) return 0;
   if (lineno <= getLines())
     { 
-	
-	if (!index.isMapped())
-			index.map();
-	
-	int res;
-    index.get((unsigned char*)&res,sizeof(int),(lineno-1)*sizeof(int));
+    qint64 res;
+    index.get((unsigned char*)&res,sizeof(qint64),(lineno-1)*(qint64)sizeof(qint64));
     return res;
     }
   return cells.len();
@@ -267,23 +316,41 @@ void HistoryScrollFile::addCells(const Character text[], int count)
 
 void HistoryScrollFile::addLine(bool previousWrapped)
 {
-  if (index.isMapped())
-		  index.unmap();
-
-  int locn = cells.len();
-  index.add((unsigned char*)&locn,sizeof(int));
+  qint64 locn = cells.len();
+  index.add((unsigned char*)&locn,sizeof(qint64));
   unsigned char flags = previousWrapped ? 0x01 : 0x00;
   lineflags.add((unsigned char*)&flags,sizeof(unsigned char));
 }
 
 
 // History Scroll Buffer //////////////////////////////////////
+
+/*
+   The lines are held in a ring of _maxLineCount entries, each of which
+   points to the line's data in one of the slabs.  New lines are added
+   to the end of the newest slab, or to a new slab if there is not
+   enough room left in it.
+
+   The data of a line is the character of each cell, followed by the
+   line's style runs.  Each run is a style and the number of consecutive
+   cells which use it, runs longer than 0xFFFF cells are split.
+
+   Since lines are removed from the history in the same order in which
+   they were added, the oldest line is always in the first slab.  Each
+   slab counts the lines which are stored in it, and when the last of
+   them is removed the slab is kept for reuse.
+*/
+
+// number of entries in each slab, longer lines get a slab of their own
+static const int SlabSize = 16 * 1024;
+
 HistoryScrollBuffer::HistoryScrollBuffer(unsigned int maxLineCount)
   : HistoryScroll(new HistoryTypeBuffer(maxLineCount))
-   ,_historyBuffer()
+   ,_historyBuffer(0)
    ,_maxLineCount(0)
    ,_usedLines(0)
    ,_head(0)
+   ,_spareSlab(0)
 {
   setMaxNbLines(maxLineCount);
 }
@@ -291,10 +358,96 @@ HistoryScrollBuffer::HistoryScrollBuffer(unsigned int maxLineCount)
 HistoryScrollBuffer::~HistoryScrollBuffer()
 {
     delete[] _historyBuffer;
+
+    foreach( const Slab& slab , _slabs )
+        delete[] slab.data;
+    delete[] _spareSlab;
+}
+
+HistoryScrollBuffer::Slab& HistoryScrollBuffer::slabFor(int size)
+{
+    if ( !_slabs.isEmpty() && _slabs.last().used + size <= _slabs.last().size )
+        return _slabs.last();
+
+    Slab slab;
+    slab.size = qMax(SlabSize,size);
+    slab.used = 0;
+    slab.lineCount = 0;
+
+    if ( slab.size == SlabSize && _spareSlab )
+    {
+        slab.data = _spareSlab;
+        _spareSlab = 0;
+    }
+    else
+    {
+        slab.data = new quint16[slab.size];
+    }
+
+    _slabs << slab;
+    return _slabs.last();
+}
+
+void HistoryScrollBuffer::removeFirstLine()
+{
+    Slab& slab = _slabs.first();
+
+    if ( --slab.lineCount > 0 )
+        return;
+
+    if ( _slabs.count() == 1 )
+    {
+        // the newest slab is reused from the start
+        slab.used = 0;
+        return;
+    }
+
+    if ( slab.size == SlabSize && !_spareSlab )
+        _spareSlab = slab.data;
+    else
+        delete[] slab.data;
+
+    _slabs.removeFirst();
 }
 
-void HistoryScrollBuffer::addCellsVector(const QVector<Character>& cells)
+void HistoryScrollBuffer::addCells(const Character a[], int count)
 {
+    // the oldest line is replaced by the new one when the history is full
+    if ( _usedLines == _maxLineCount )
+        removeFirstLine();
+
+    // count the style runs first so that the slab space can be reserved
+    int runCount = 0;
+    int runLength = 0;
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        if ( i == 0 || a[i].style != a[i-1].style || runLength == 0xFFFF )
+        {
+            runCount++;
+            runLength = 0;
+        }
+        runLength++;
+    }
+
+    Slab& slab = slabFor(count + runCount * 2);
+    quint16* characters = slab.data + slab.used;
+    slab.used += count + runCount * 2;
+    slab.lineCount++;
+
+    quint16* run = characters + count - 2;
+    for ( int i = 0 ; i < count ; i++ )
+    {
+        characters[i] = a[i].character;
+
+        if ( i == 0 || a[i].style != run[0] || run[1] == 0xFFFF )
+        {
+            run += 2;
+            run[0] = a[i].style;
+            run[1] = 0;
+        }
+        run[1]++;
+    }
+
     _head++;
     if ( _usedLines < _maxLineCount )
         _usedLines++;
@@ -304,16 +457,12 @@ void HistoryScrollBuffer::addCellsVector(const QVector<Character>& cells)
         _head = 0;
     }
 
-    _historyBuffer[bufferIndex(_usedLines-1)] = cells;
+    HistoryLine& line = _historyBuffer[bufferIndex(_usedLines-1)];
+    line.characters = characters;
+    line.length = count;
+    line.runCount = runCount;
     _wrappedLine[bufferIndex(_usedLines-1)] = false;
 }
-void HistoryScrollBuffer::addCells(const Character a[], int count)
-{
-  HistoryLine newLine(count);
-  qCopy(a,a+count,newLine.begin());
-
-  addCellsVector(newLine);
-}
 
 void HistoryScrollBuffer::addLine(bool previousWrapped)
 {
@@ -331,7 +480,7 @@ int HistoryScrollBuffer::getLineLen(int lineNumber)
 
   if ( lineNumber < _usedLines )
   {
-    return _historyBuffer[bufferIndex(lineNumber)].size();
+    return _historyBuffer[bufferIndex(lineNumber)].length;
   }
   else
   {
@@ -367,32 +516,54 @@ void HistoryScrollBuffer::getCells(int lineNumber, int startColumn, int count, C
   const HistoryLine& line = _historyBuffer[bufferIndex(lineNumber)];
 
   //kDebug() << "startCol " << startColumn;
-  //kDebug() << "line.size() " << line.size();
+  //kDebug() << "line.length " << line.length;
   //kDebug() << "count " << count;
 
-  Q_ASSERT( startColumn <= line.size() - count );
-    
-  memcpy(buffer, line.constData() + startColumn , count * sizeof(Character));
+  Q_ASSERT( startColumn <= line.length - count );
+
+  const quint16* characters = line.characters + startColumn;
+  for ( int i = 0 ; i < count ; i++ )
+    buffer[i].character = characters[i];
+
+  // apply the styles of the runs which overlap the requested cells
+  const int endColumn = startColumn + count;
+  const quint16* run = line.characters + line.length;
+  int runStart = 0;
+  for ( int i = 0 ; i < line.runCount && runStart < endColumn ; i++ , run += 2 )
+  {
+    const int runEnd = runStart + run[1];
+    for ( int column = qMax(runStart,startColumn) ; column < qMin(runEnd,endColumn) ; column++ )
+      buffer[column - startColumn].style = run[0];
+    runStart = runEnd;
+  }
 }
 
 void HistoryScrollBuffer::setMaxNbLines(unsigned int lineCount)
 {
-    HistoryLine* oldBuffer = _historyBuffer;
+    // only the index of the lines is copied, the cells stay where they are.
+    // if the history is shrinking, the newest lines are kept
+    const int keepCount = qMin(_usedLines,(int)lineCount);
+    const int firstLine = _usedLines - keepCount;
+
+    for ( int i = 0 ; i < firstLine ; i++ )
+        removeFirstLine();
+
     HistoryLine* newBuffer = new HistoryLine[lineCount];
-    
-    for ( int i = 0 ; i < qMin(_usedLines,(int)lineCount) ; i++ )
+    QBitArray newWrappedLine(lineCount);
+
+    for ( int i = 0 ; i < keepCount ; i++ )
     {
-        newBuffer[i] = oldBuffer[bufferIndex(i)];
+        newBuffer[i] = _historyBuffer[bufferIndex(firstLine+i)];
+        newWrappedLine[i] = _wrappedLine[bufferIndex(firstLine+i)];
     }
-    
-    _usedLines = qMin(_usedLines,(int)lineCount);
-    _maxLineCount = lineCount;
-    _head = ( _usedLines == _maxLineCount ) ? 0 : _usedLines-1;
 
+    delete[] _historyBuffer;
     _historyBuffer = newBuffer;
-    delete[] oldBuffer;
+    _wrappedLine = newWrappedLine;
 
-    _wrappedLine.resize(lineCount);
+    _usedLines = keepCount;
+    _maxLineCount = lineCount;
+    _head = _usedLines-1;
 }
 
 int HistoryScrollBuffer::bufferIndex(int lineNumber)
@@ -412,6 +583,487 @@ int HistoryScrollBuffer::bufferIndex(int lineNumber)
 }
 
 
+// History Compressor //////////////////////////////////////
+
+// zlib compression level used for history blocks.  the output of most
+// programs is repetitive enough that the fastest level compresses it nearly
+// as well as the default level does, at a fraction of the cost
+static const int CompressionLevel = 1;
+
+namespace Konsole
+{
+
+/*
+   Compresses the blocks of HistoryScrollCompressed instances on a
+   low priority background thread which is shared by all histories.
+
+   Blocks are compressed in the order in which they are queued.  The
+   worker thread never touches the blocks themselves, the history
+   collects the compressed data with takeResult() instead.
+*/
+class HistoryCompressor
+{
+public:
+  typedef HistoryScrollCompressed::Block Block;
+
+  HistoryCompressor();
+  ~HistoryCompressor();
+
+  static HistoryCompressor* instance();
+
+  // queues @p data to be compressed on behalf of @p block
+  void compress(const Block* block , const QByteArray& data);
+  // if the compressed data for @p block is ready, removes it from the
+  // compressor, copies it into @p result and returns true
+  bool takeResult(const Block* block , QByteArray& result);
+  // discards any queued or finished work for @p block and waits until
+  // the worker thread is no longer compressing it.  this must be called
+  // before a block which was passed to compress() is deleted
+  void cancel(const Block* block);
+
+private:
+  class WorkerThread;
+  friend class WorkerThread;
+
+  class Job
+  {
+  public:
+    const Block* block;
+    QByteArray data;
+  };
+
+  // main loop of the worker thread
+  void processJobs();
+
+  QThread* _thread;
+  QMutex _mutex;
+  QWaitCondition _jobAvailable;
+  QWaitCondition _jobFinished;
+  QList<Job> _queue;
+  QHash<const Block*,QByteArray> _results;
+  // the block which the worker thread is compressing, or 0
+  const Block* _currentBlock;
+  bool _quit;
+};
+
+}
+
+class HistoryCompressor::WorkerThread : public QThread
+{
+public:
+  WorkerThread(HistoryCompressor* compressor) : _compressor(compressor) {}
+
+protected:
+  virtual void run() { _compressor->processJobs(); }
+
+private:
+  HistoryCompressor* _compressor;
+};
+
+HistoryCompressor::HistoryCompressor()
+  : _currentBlock(0)
+  , _quit(false)
+{
+  _thread = new WorkerThread(this);
+  _thread->start(QThread::LowPriority);
+}
+
+HistoryCompressor::~HistoryCompressor()
+{
+  _mutex.lock();
+  _quit = true;
+  _jobAvailable.wakeAll();
+  _mutex.unlock();
+
+  _thread->wait();
+  delete _thread;
+}
+
+K_GLOBAL_STATIC( HistoryCompressor , theHistoryCompressor )
+HistoryCompressor* HistoryCompressor::instance()
+{
+  return theHistoryCompressor;
+}
+
+void HistoryCompressor::compress(const Block* block , const QByteArray& data)
+{
+  QMutexLocker locker(&_mutex);
+
+  Job job;
+  job.block = block;
+  job.data = data;
+  _queue << job;
+
+  _jobAvailable.wakeOne();
+}
+
+bool HistoryCompressor::takeResult(const Block* block , QByteArray& result)
+{
+  QMutexLocker locker(&_mutex);
+
+  if ( !_results.contains(block) )
+    return false;
+
+  result = _results.take(block);
+  return true;
+}
+
+void HistoryCompressor::cancel(const Block* block)
+{
+  QMutexLocker locker(&_mutex);
+
+  for ( int i = 0 ; i < _queue.count() ; i++ )
+  {
+    if ( _queue[i].block == block )
+    {
+      _queue.removeAt(i);
+      break;
+    }
+  }
+
+  while ( _currentBlock == block )
+    _jobFinished.wait(&_mutex);
+
+  _results.remove(block);
+}
+
+void HistoryCompressor::processJobs()
+{
+  QMutexLocker locker(&_mutex);
+
+  while ( !_quit )
+  {
+    if ( _queue.isEmpty() )
+    {
+      _jobAvailable.wait(&_mutex);
+      continue;
+    }
+
+    Job job = _queue.takeFirst();
+    _currentBlock = job.block;
+
+    locker.unlock();
+    QByteArray result = qCompress(job.data,CompressionLevel);
+    locker.relock();
+
+    _results.insert(job.block,result);
+    _currentBlock = 0;
+    _jobFinished.wakeAll();
+  }
+}
+
+// History Scroll Compressed //////////////////////////////////////
+
+/*
+   The lines are stored in two parts.  The most recent lines are
+   kept uncompressed in _hotLines, in the same form as HistoryScrollBuffer.
+   Once there are more than HotLineCount of them, the oldest BlockLineCount
+   lines are sealed into a Block.
+
+   The data of a block is the length of each line, followed by the
+   characters of all the cells, followed by the number of style runs and
+   the runs themselves, each of which is a style and the number of
+   consecutive cells which use it.  Most cells use the same few styles,
+   so this keeps the amount of data which has to be compressed down.
+   The data is compressed by the HistoryCompressor and replaced with the
+   compressed version when it is ready.
+
+   When the history is full, lines are removed from the first block
+   by incrementing _removedLines, and the block is deleted once all of
+   its lines have been removed.
+*/
+
+// number of lines which are kept uncompressed
+static const int HotLineCount = 1024;
+// number of lines which are compressed together
+static const int BlockLineCount = 256;
+// maximum number of decompressed blocks which are cached
+static const int CachedBlockCount = 8;
+
+HistoryScrollCompressed::HistoryScrollCompressed(unsigned int maxLineCount)
+  : HistoryScroll(new HistoryTypeCompressed(maxLineCount))
+   ,_removedLines(0)
+   ,_firstBlockKey(0)
+   ,_cache(CachedBlockCount)
+   ,_maxLineCount(maxLineCount)
+{
+}
+
+HistoryScrollCompressed::~HistoryScrollCompressed()
+{
+  foreach( Block* block , _pendingBlocks )
+    HistoryCompressor::instance()->cancel(block);
+
+  qDeleteAll(_blocks);
+}
+
+int HistoryScrollCompressed::sealedLines() const
+{
+  return _blocks.count() * BlockLineCount - _removedLines;
+}
+
+int HistoryScrollCompressed::getLines()
+{
+  return sealedLines() + _hotLines.count();
+}
+
+void HistoryScrollCompressed::addCells(const Character a[], int count)
+{
+  HistoryLine newLine(count);
+  qCopy(a,a+count,newLine.begin());
+
+  addCellsVector(newLine);
+}
+
+void HistoryScrollCompressed::addCellsVector(const QVector<Character>& cells)
+{
+  HotLine line;
+  line.cells = cells;
+  line.wrapped = false;
+  _hotLines << line;
+
+  if ( _maxLineCount > 0 && getLines() > _maxLineCount )
+    removeFirstLine();
+
+  if ( _hotLines.count() >= HotLineCount + BlockLineCount )
+    sealBlock();
+}
+
+void HistoryScrollCompressed::addLine(bool previousWrapped)
+{
+  if ( !_hotLines.isEmpty() )
+    _hotLines.last().wrapped = previousWrapped;
+}
+
+void HistoryScrollCompressed::sealBlock()
+{
+  // count the cells and style runs first so that the data
+  // can be allocated in one go
+  // the runs must be split in the same places as in the write pass below
+  int cellCount = 0;
+  int runCount = 0;
+  int runLength = 0;
+  quint16 lastStyle = 0;
+  for ( int i = 0 ; i < BlockLineCount ; i++ )
+  {
+    const HistoryLine& cells = _hotLines[i].cells;
+    for ( int j = 0 ; j < cells.count() ; j++ )
+    {
+      if ( runCount == 0 || cells[j].style != lastStyle || runLength == 0xFFFF )
+      {
+        lastStyle = cells[j].style;
+        runCount++;
+        runLength = 0;
+      }
+      runLength++;
+    }
+    cellCount += cells.count();
+  }
+
+  Block* block = new Block;
+  block->wrapped.resize(BlockLineCount);
+  block->data.resize( (BlockLineCount + 1) * sizeof(int) +
+                      (cellCount + runCount * 2) * sizeof(quint16) );
+
+  int* lengths = reinterpret_cast<int*>(block->data.data());
+  quint16* characters = reinterpret_cast<quint16*>(lengths + BlockLineCount + 1);
+  quint16* runs = characters + cellCount;
+  lengths[BlockLineCount] = runCount;
+
+  quint16* run = runs - 2;
+  for ( int i = 0 ; i < BlockLineCount ; i++ )
+  {
+    const HotLine line = _hotLines.takeFirst();
+    const Character* cells = line.cells.constData();
+    const int count = line.cells.count();
+
+    lengths[i] = count;
+    block->wrapped[i] = line.wrapped;
+    for ( int j = 0 ; j < count ; j++ )
+    {
+      *characters++ = cells[j].character;
+
+      if ( run < runs || cells[j].style != run[0] || run[1] == 0xFFFF )
+      {
+        run += 2;
+        run[0] = cells[j].style;
+        run[1] = 0;
+      }
+      run[1]++;
+    }
+  }
+
+  _blocks << block;
+  _pendingBlocks << block;
+  HistoryCompressor::instance()->compress(block,block->data);
+
+  collectCompressedBlocks();
+}
+
+void HistoryScrollCompressed::collectCompressedBlocks()
+{
+  // the blocks are compressed in order, so stop at the first one which
+  // has not been compressed yet
+  while ( !_pendingBlocks.isEmpty() )
+  {
+    Block* block = _pendingBlocks.first();
+    QByteArray result;
+
+    if ( !HistoryCompressor::instance()->takeResult(block,result) )
+      break;
+
+    block->data = result;
+    block->compressed = true;
+    _pendingBlocks.removeFirst();
+  }
+}
+
+void HistoryScrollCompressed::removeFirstLine()
+{
+  if ( _blocks.isEmpty() )
+  {
+    _hotLines.removeFirst();
+    return;
+  }
+
+  if ( ++_removedLines < BlockLineCount )
+    return;
+
+  Block* block = _blocks.takeFirst();
+  if ( _pendingBlocks.removeAll(block) > 0 )
+    HistoryCompressor::instance()->cancel(block);
+  delete block;
+
+  _cache.remove(_firstBlockKey);
+  _firstBlockKey++;
+  _removedLines = 0;
+}
+
+const HistoryScrollCompressed::DecodedBlock* HistoryScrollCompressed::decodedBlock(int index)
+{
+  const int key = _firstBlockKey + index;
+
+  DecodedBlock* decoded = _cache.object(key);
+  if ( decoded )
+    return decoded;
+
+  collectCompressedBlocks();
+
+  const Block* block = _blocks[index];
+  const QByteArray data = block->compressed ? qUncompress(block->data) : block->data;
+
+  const int* lengths = reinterpret_cast<const int*>(data.constData());
+  const int runCount = lengths[BlockLineCount];
+
+  decoded = new DecodedBlock;
+  decoded->lineStarts.resize(BlockLineCount+1);
+  decoded->lineStarts[0] = 0;
+  for ( int i = 0 ; i < BlockLineCount ; i++ )
+    decoded->lineStarts[i+1] = decoded->lineStarts[i] + lengths[i];
+
+  const int cellCount = decoded->lineStarts[BlockLineCount];
+
+  Q_ASSERT( data.size() == int((BlockLineCount + 1) * sizeof(int) +
+                               (cellCount + runCount * 2) * sizeof(quint16)) );
+
+  const quint16* characters = reinterpret_cast<const quint16*>(lengths + BlockLineCount + 1);
+  const quint16* run = characters + cellCount;
+
+  decoded->cells.resize(cellCount);
+  Character* cells = decoded->cells.data();
+  for ( int i = 0 ; i < cellCount ; i++ )
+    cells[i].character = characters[i];
+
+  for ( int i = 0 ; i < runCount ; i++ , run += 2 )
+  {
+    for ( int j = 0 ; j < run[1] ; j++ )
+      (cells++)->style = run[0];
+  }
+
+  _cache.insert(key,decoded);
+  return decoded;
+}
+
+int HistoryScrollCompressed::getLineLen(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 );
+
+  const int sealed = sealedLines();
+  if ( lineNumber >= sealed )
+  {
+    if ( lineNumber - sealed < _hotLines.count() )
+      return _hotLines[lineNumber - sealed].cells.count();
+    else
+      return 0;
+  }
+
+  const int line = lineNumber + _removedLines;
+  const DecodedBlock* block = decodedBlock(line / BlockLineCount);
+  const int start = line % BlockLineCount;
+
+  return block->lineStarts[start+1] - block->lineStarts[start];
+}
+
+bool HistoryScrollCompressed::isWrappedLine(int lineNumber)
+{
+  Q_ASSERT( lineNumber >= 0 );
+
+  const int sealed = sealedLines();
+  if ( lineNumber >= sealed )
+  {
+    if ( lineNumber - sealed < _hotLines.count() )
+      return _hotLines[lineNumber - sealed].wrapped;
+    else
+      return false;
+  }
+
+  const int line = lineNumber + _removedLines;
+  return _blocks[line / BlockLineCount]->wrapped[line % BlockLineCount];
+}
+
+void HistoryScrollCompressed::getCells(int lineNumber, int startColumn, int count, Character* buffer)
+{
+  if ( count == 0 ) return;
+
+  Q_ASSERT( lineNumber >= 0 );
+
+  if ( lineNumber >= getLines() )
+  {
+    memset(buffer, 0, count * sizeof(Character));
+    return;
+  }
+
+  const int sealed = sealedLines();
+  if ( lineNumber >= sealed )
+  {
+    const HistoryLine& line = _hotLines[lineNumber - sealed].cells;
+
+    Q_ASSERT( startColumn <= line.size() - count );
+
+    memcpy(buffer, line.constData() + startColumn , count * sizeof(Character));
+    return;
+  }
+
+  const int line = lineNumber + _removedLines;
+  const DecodedBlock* block = decodedBlock(line / BlockLineCount);
+  const int start = block->lineStarts[line % BlockLineCount];
+
+  Q_ASSERT( start + startColumn + count <= block->lineStarts[line % BlockLineCount + 1] );
+
+  memcpy(buffer, block->cells.constData() + start + startColumn , count * sizeof(Character));
+}
+
+void HistoryScrollCompressed::setMaxNbLines(unsigned int lineCount)
+{
+  _maxLineCount = lineCount;
+
+  while ( _maxLineCount > 0 && getLines() > _maxLineCount )
+    removeFirstLine();
+
+  delete m_histType;
+  m_histType = new HistoryTypeCompressed(lineCount);
+}
+
 // History Scroll None //////////////////////////////////////
 
 HistoryScrollNone::HistoryScrollNone()
@@ -457,10 +1109,41 @@ void HistoryScrollNone::addLine(bool)
 
 // History Scroll BlockArray //////////////////////////////////////
 
+// the entries of a block's line directory are stored backwards from the end
+// of the block, each entry holds the position within the block at which the
+// line ends and the wrapped flag
+static const quint32 BlockLineWrapped = 0x80000000;
+
+static inline quint32* blockLineDirectory(Block* block)
+{
+  return reinterpret_cast<quint32*>(block->data + ENTRIES);
+}
+static inline const quint32* blockLineDirectory(const Block* block)
+{
+  return reinterpret_cast<const quint32*>(block->data + ENTRIES);
+}
+static inline int blockCellCount(const Block* block)
+{
+  return block->size / sizeof(Character);
+}
+
 HistoryScrollBlockArray::HistoryScrollBlockArray(size_t size)
-  : HistoryScroll(new HistoryTypeBlockArray(size))
+  : HistoryScroll(new HistoryTypeBlockArray(size)),
+    m_firstBlock(0),
+    m_lineCount(0),
+    m_firstLine(0),
+    m_lineStart(0)
 {
-  m_blockArray.setHistorySize(size); // nb. of lines.
+  m_blockArray.setSize(size);
+
+  if (m_blockArray.lastBlock())
+  {
+    BlockInfo info;
+    info.firstLine = 0;
+    info.start = 0;
+    info.lineStart = 0;
+    m_blocks << info;
+  }
 }
 
 HistoryScrollBlockArray::~HistoryScrollBlockArray()
@@ -469,20 +1152,79 @@ HistoryScrollBlockArray::~HistoryScrollBlockArray()
 
 int  HistoryScrollBlockArray::getLines()
 {
-  return m_lineLengths.count();
+  return qMax(0,m_lineCount - m_firstLine);
 }
 
-int  HistoryScrollBlockArray::getLineLen(int lineno)
+int HistoryScrollBlockArray::findLine(int lineno, qint64& start, qint64& end, bool* wrapped)
 {
-    if ( m_lineLengths.contains(lineno) )
-        return m_lineLengths[lineno];
+  const int line = m_firstLine + lineno;
+  assert(lineno >= 0 && line < m_lineCount);
+
+  // find the last block whose first line is not after the line,
+  // which is the block in which the line ends
+  int low = 0;
+  int high = m_blocks.count();
+  while (high - low > 1)
+  {
+    const int mid = (low + high) / 2;
+    if (m_blocks[mid].firstLine <= line)
+      low = mid;
     else
-        return 0;
+      high = mid;
+  }
+
+  const BlockInfo& info = m_blocks[low];
+  const Block* block = m_blockArray.at(m_firstBlock + low);
+  if (!block)
+    return -1;
+
+  const int entry = line - info.firstLine;
+  const quint32* directory = blockLineDirectory(block);
+  const quint32 lineEnd = directory[-1 - entry];
+
+  start = entry == 0 ? info.lineStart
+                     : info.start + (directory[-entry] & ~BlockLineWrapped);
+  end = info.start + (lineEnd & ~BlockLineWrapped);
+  if (wrapped)
+    *wrapped = lineEnd & BlockLineWrapped;
+
+  return low;
 }
 
-bool HistoryScrollBlockArray::isWrappedLine(int /*lineno*/)
+int HistoryScrollBlockArray::blockAt(qint64 position, int last) const
 {
-  return false;
+  int low = 0;
+  int high = last + 1;
+  while (high - low > 1)
+  {
+    const int mid = (low + high) / 2;
+    if (m_blocks[mid].start <= position)
+      low = mid;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+int  HistoryScrollBlockArray::getLineLen(int lineno)
+{
+  qint64 start = 0;
+  qint64 end = 0;
+  if (findLine(lineno,start,end) < 0)
+    return 0;
+
+  return end - start;
+}
+
+bool HistoryScrollBlockArray::isWrappedLine(int lineno)
+{
+  qint64 start = 0;
+  qint64 end = 0;
+  bool wrapped = false;
+  if (findLine(lineno,start,end,&wrapped) < 0)
+    return false;
+
+  return wrapped;
 }
 
 void HistoryScrollBlockArray::getCells(int lineno, int colno,
@@ -490,40 +1232,112 @@ void HistoryScrollBlockArray::getCells(int lineno, int colno,
 {
   if (!count) return;
 
-  const Block *b = m_blockArray.at(lineno);
+  qint64 start = 0;
+  qint64 end = 0;
+  int index = findLine(lineno,start,end);
 
-  if (!b) {
-    memset(res, 0, count * sizeof(Character)); // still better than random data
-    return;
+  if (index >= 0)
+  {
+    const qint64 position = start + colno;
+    assert(position + count <= end);
+
+    // the start of a line may be in an earlier block than its end
+    if (position < m_blocks[index].start)
+      index = blockAt(position,index);
+
+    int offset = position - m_blocks[index].start;
+    while (count > 0)
+    {
+      const Block* block = m_blockArray.at(m_firstBlock + index);
+      if (!block)
+        break;
+
+      const int n = qMin(count,blockCellCount(block) - offset);
+      memcpy(res, block->data + offset * sizeof(Character), n * sizeof(Character));
+      res += n;
+      count -= n;
+      offset = 0;
+      index++;
+    }
   }
 
-  assert(((colno + count) * sizeof(Character)) < ENTRIES);
-  memcpy(res, b->data + (colno * sizeof(Character)), count * sizeof(Character));
+  if (count > 0)
+    memset(res, 0, count * sizeof(Character)); // still better than random data
+}
+
+void HistoryScrollBlockArray::appendBlock()
+{
+  const BlockInfo& last = m_blocks.last();
+
+  BlockInfo info;
+  info.firstLine = m_lineCount;
+  info.start = last.start + blockCellCount(m_blockArray.lastBlock());
+  info.lineStart = m_lineStart;
+
+  size_t index = m_blockArray.newBlock();
+  Q_UNUSED( index );
+  assert(index == m_firstBlock + m_blocks.count());
+  m_blocks << info;
+
+  // the BlockArray drops its oldest block once it is full, the lines
+  // which start in that block are no longer available
+  while (m_blocks.count() > int(m_blockArray.len()) + 1)
+  {
+    m_blocks.removeFirst();
+    m_firstBlock++;
+
+    const BlockInfo& first = m_blocks.first();
+    m_firstLine = qMax(m_firstLine,first.lineStart < first.start ? first.firstLine + 1
+                                                                 : first.firstLine);
+  }
 }
 
 void HistoryScrollBlockArray::addCells(const Character a[], int count)
 {
   Block *b = m_blockArray.lastBlock();
-  
-  if (!b) return;
-
-  // put cells in block's data
-  assert((count * sizeof(Character)) < ENTRIES);
 
-  memset(b->data, 0, ENTRIES);
+  if (!b) return;
 
-  memcpy(b->data, a, count * sizeof(Character));
-  b->size = count * sizeof(Character);
+  for (;;)
+  {
+    // keep space in the line directory for the end of the line
+    const int linesInBlock = m_lineCount - m_blocks.last().firstLine;
+    const int space = int(ENTRIES) - int(b->size) - (linesInBlock + 1) * int(sizeof(quint32));
 
-  size_t res = m_blockArray.newBlock();
-  assert (res > 0);
-  Q_UNUSED( res );
+    if (space >= 0)
+    {
+      const int n = qMin(count,space / int(sizeof(Character)));
+      memcpy(b->data + b->size, a, n * sizeof(Character));
+      b->size += n * sizeof(Character);
+      a += n;
+      count -= n;
+
+      if (count == 0)
+        break;
+    }
 
-  m_lineLengths.insert(m_blockArray.getCurrent(), count);
+    appendBlock();
+    b = m_blockArray.lastBlock();
+  }
 }
 
-void HistoryScrollBlockArray::addLine(bool)
+void HistoryScrollBlockArray::addLine(bool previousWrapped)
 {
+  Block *b = m_blockArray.lastBlock();
+
+  if (!b) return;
+
+  const BlockInfo& info = m_blocks.last();
+  const int linesInBlock = m_lineCount - info.firstLine;
+  assert(b->size + (linesInBlock + 1) * sizeof(quint32) <= ENTRIES);
+
+  quint32 lineEnd = blockCellCount(b);
+  if (previousWrapped)
+    lineEnd |= BlockLineWrapped;
+  blockLineDirectory(b)[-1 - linesInBlock] = lineEnd;
+
+  m_lineCount++;
+  m_lineStart = info.start + blockCellCount(b);
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -645,6 +1459,53 @@ HistoryScroll* HistoryTypeBuffer::scroll(HistoryScroll *old) const
 
 //////////////////////////////
 
+const int HistoryTypeCompressed::CompressionThreshold;
+
+HistoryTypeCompressed::HistoryTypeCompressed(unsigned int nbLines)
+  : m_nbLines(nbLines)
+{
+}
+
+bool HistoryTypeCompressed::isEnabled() const
+{
+  return true;
+}
+
+int HistoryTypeCompressed::maximumLineCount() const
+{
+  return m_nbLines;
+}
+
+HistoryScroll* HistoryTypeCompressed::scroll(HistoryScroll *old) const
+{
+  HistoryScrollCompressed *oldCompressed = dynamic_cast<HistoryScrollCompressed*>(old);
+  if (oldCompressed)
+  {
+    oldCompressed->setMaxNbLines(m_nbLines);
+    return oldCompressed;
+  }
+
+  HistoryScroll *newScroll = new HistoryScrollCompressed(m_nbLines);
+  int lines = (old != 0) ? old->getLines() : 0;
+  int startLine = 0;
+  if (m_nbLines > 0 && lines > (int) m_nbLines)
+    startLine = lines - m_nbLines;
+
+  QVector<Character> line;
+  for(int i = startLine; i < lines; i++)
+  {
+    line.resize(old->getLineLen(i));
+    old->getCells(i, 0, line.size(), line.data());
+    newScroll->addCellsVector(line);
+    newScroll->addLine(old->isWrappedLine(i));
+  }
+
+  delete old;
+  return newScroll;
+}
+
+//////////////////////////////
+
 HistoryTypeFile::HistoryTypeFile(const QString& fileName)
   : m_fileName(fileName)
 {
@@ -662,7 +1523,7 @@ const QString& HistoryTypeFile::getFileName() const
 
 HistoryScroll* HistoryTypeFile::scroll(HistoryScroll *old) const
 {
-  if (dynamic_cast<HistoryFile *>(old)) 
+  if (dynamic_cast<HistoryScrollFile *>(old))
      return old; // Unchanged.
 
   HistoryScroll *newScroll = new HistoryScrollFile(m_fileName);
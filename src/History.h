@@ -23,7 +23,9 @@
 
 // Qt
 #include <QtCore/QBitRef>
+#include <QtCore/QCache>
 #include <QtCore/QHash>
+#include <QtCore/QList>
 #include <QtCore/QVector>
 
 // KDE
@@ -39,6 +41,13 @@ namespace Konsole
 #if 1
 /*
    An extendable tmpfile(1) based buffer.
+
+   Added data is collected in a buffer and written to the file in large
+   blocks.  Data is read through read-only mappings of fixed size segments
+   of the file, so that only the parts of the file which are in use are
+   mapped.  Since data is only ever added to the end of the file, mapped
+   segments never become invalid and are only unmapped when too many are
+   in use.
 */
 
 class HistoryFile
@@ -48,33 +57,36 @@ public:
   virtual ~HistoryFile();
 
   virtual void add(const unsigned char* bytes, int len);
-  virtual void get(unsigned char* bytes, int len, int loc);
-  virtual int  len();
-
-  //mmaps the file in read-only mode
-  void map();
-  //un-mmaps the file
-  void unmap();
-  //returns true if the file is mmap'ed
-  bool isMapped();
-
+  virtual void get(unsigned char* bytes, int len, qint64 loc);
+  virtual qint64 len();
 
 private:
+  // writes the contents of the write buffer to the file
+  void flush();
+  void write(const char* bytes, int len);
+  // returns the mapping of the segment at @p index, or 0 if it
+  // cannot be mapped
+  const char* segment(qint64 index);
+
+  class Segment
+  {
+  public:
+    qint64 index;
+    char* data;
+  };
+
   int  ion;
-  int  length;
   KTemporaryFile tmpFile;
 
-  //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-  char* fileMap;
- 
-  //incremented whenver 'add' is called and decremented whenever
-  //'get' is called.
-  //this is used to detect when a large number of lines are being read and processed from the history
-  //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-  int readWriteBalance;
-
-  //when readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-  static const int MAP_THRESHOLD = -1000;
+  // number of bytes which have been written to the file
+  qint64 fileLength;
+
+  // data added since the last flush(), allocated when it is first needed
+  char* writeBuffer;
+  int writeBufferLength;
+
+  // mapped segments of the file, most recently used first
+  QList<Segment> segments;
 };
 #endif
 
@@ -146,10 +158,10 @@ public:
   virtual void addLine(bool previousWrapped=false);
 
 private:
-  int startOfLine(int lineno);
+  qint64 startOfLine(int lineno);
 
   QString m_logFileName;
-  HistoryFile index; // lines Row(int)
+  HistoryFile index; // lines Row(qint64)
   HistoryFile cells; // text  Row(Character)
   HistoryFile lineflags; // flags Row(unsigned char)
 };
@@ -158,11 +170,21 @@ private:
 //////////////////////////////////////////////////////////////////////
 // Buffer-based history (limited to a fixed nb of lines)
 //////////////////////////////////////////////////////////////////////
+
+/**
+ * A history which holds a fixed number of lines in memory.
+ *
+ * The lines are packed one after another into large slabs rather than
+ * each line being allocated separately.  Once all the lines in the oldest
+ * slab have been removed from the history the slab is reused for new lines.
+ *
+ * Each line is stored as the characters of its cells followed by a list of
+ * style runs, since most lines use only one or two styles.  The cells are
+ * put back together when they are read.
+ */
 class HistoryScrollBuffer : public HistoryScroll
 {
 public:
-  typedef QVector<Character> HistoryLine;
-
   HistoryScrollBuffer(unsigned int maxNbLines = 1000);
   virtual ~HistoryScrollBuffer();
 
@@ -172,7 +194,6 @@ public:
   virtual bool isWrappedLine(int lineno);
 
   virtual void addCells(const Character a[], int count);
-  virtual void addCellsVector(const QVector<Character>& cells);
   virtual void addLine(bool previousWrapped=false);
 
   void setMaxNbLines(unsigned int nbLines);
@@ -180,13 +201,43 @@ public:
   
 
 private:
+  class Slab
+  {
+  public:
+    quint16* data;
+    int size;
+    // number of entries in use
+    int used;
+    // number of lines in the history which are stored in this slab
+    int lineCount;
+  };
+
+  class HistoryLine
+  {
+  public:
+    // the characters of the line's cells, followed by runCount
+    // pairs of a style and the number of cells which use it
+    const quint16* characters;
+    int length;
+    int runCount;
+  };
+
   int bufferIndex(int lineNumber);
+  // returns a slab with space for @p size more entries at the end
+  Slab& slabFor(int size);
+  // removes the oldest line from the history
+  void removeFirstLine();
 
   HistoryLine* _historyBuffer;
   QBitArray _wrappedLine;
   int _maxLineCount;
   int _usedLines;  
   int _head;
+
+  // slabs holding the cells of the lines, from oldest to newest
+  QList<Slab> _slabs;
+  // an unused slab which is kept for reuse
+  quint16* _spareSlab;
   
   //QVector<histline*> m_histBuffer;
   //QBitArray m_wrappedLine;
@@ -196,6 +247,100 @@ private:
   //bool         m_buffFilled;
 };
 
+//////////////////////////////////////////////////////////////////////
+// Compressed history (limited to a fixed nb of lines or unlimited)
+//////////////////////////////////////////////////////////////////////
+
+/**
+ * A history which keeps the most recent lines uncompressed and seals
+ * older lines into blocks which are compressed with qCompress() on a
+ * background thread.
+ *
+ * The characters and styles of the cells in a block are stored separately
+ * before compression, since the output of most programs is very repetitive
+ * this typically reduces the size of the lines by a factor of 10 or more.
+ *
+ * Blocks are decompressed when lines from them are read and the most recently
+ * used blocks are cached, so reading nearby lines repeatedly is cheap.
+ */
+class HistoryScrollCompressed : public HistoryScroll
+{
+public:
+  typedef QVector<Character> HistoryLine;
+
+  /**
+   * Constructs a new history which holds up to @p maxNbLines lines,
+   * or an unlimited number of lines if @p maxNbLines is 0.
+   */
+  HistoryScrollCompressed(unsigned int maxNbLines = 0);
+  virtual ~HistoryScrollCompressed();
+
+  virtual int  getLines();
+  virtual int  getLineLen(int lineno);
+  virtual void getCells(int lineno, int colno, int count, Character res[]);
+  virtual bool isWrappedLine(int lineno);
+
+  virtual void addCells(const Character a[], int count);
+  virtual void addCellsVector(const QVector<Character>& cells);
+  virtual void addLine(bool previousWrapped=false);
+
+  void setMaxNbLines(unsigned int nbLines);
+  unsigned int maxNbLines() { return _maxLineCount; }
+
+private:
+  friend class HistoryCompressor;
+
+  // a sealed block of BlockLineCount lines
+  class Block
+  {
+  public:
+    Block() : compressed(false) {}
+
+    QBitArray wrapped;
+    // the line lengths, characters and styles of the block's lines, which
+    // are compressed once the HistoryCompressor has finished with them
+    QByteArray data;
+    bool compressed;
+  };
+
+  // the cells of a block after decompression
+  class DecodedBlock
+  {
+  public:
+    QVector<int> lineStarts;
+    QVector<Character> cells;
+  };
+
+  class HotLine
+  {
+  public:
+    HistoryLine cells;
+    bool wrapped;
+  };
+
+  // returns the decoded cells of the block at @p index in _blocks
+  const DecodedBlock* decodedBlock(int index);
+  // moves the oldest BlockLineCount uncompressed lines into a new block
+  void sealBlock();
+  // replaces the data of blocks which the compressor has finished with
+  void collectCompressedBlocks();
+  void removeFirstLine();
+  // number of lines in the sealed blocks
+  int sealedLines() const;
+
+  QList<HotLine> _hotLines;
+  QList<Block*> _blocks;
+  // blocks waiting to be compressed, in the order they were sealed
+  QList<Block*> _pendingBlocks;
+  // number of lines at the start of the first block which have been removed
+  int _removedLines;
+  // the cache key of the first block, incremented when it is removed
+  int _firstBlockKey;
+  QCache<int,DecodedBlock> _cache;
+
+  int _maxLineCount;
+};
+
 /*class HistoryScrollBufferV2 : public HistoryScroll
 {
 public:
@@ -235,9 +380,19 @@ public:
 //////////////////////////////////////////////////////////////////////
 // BlockArray-based history
 //////////////////////////////////////////////////////////////////////
+/**
+ * A history which stores lines in the fixed size blocks of a BlockArray.
+ *
+ * Lines are packed into the blocks one after another and a line which does
+ * not fit into the remaining space of a block continues in the next one.
+ * The end of each line which ends in a block and whether the line is wrapped
+ * is recorded in a directory at the end of the block.  When the BlockArray
+ * is full, the oldest block is dropped along with the lines which start in it.
+ */
 class HistoryScrollBlockArray : public HistoryScroll
 {
 public:
+  /** Constructs a new history which uses up to @p size KB to store lines. */
   HistoryScrollBlockArray(size_t size);
   virtual ~HistoryScrollBlockArray();
 
@@ -250,8 +405,42 @@ public:
   virtual void addLine(bool previousWrapped=false);
 
 protected:
+  // the position of a block's contents in the history, kept in memory
+  // so that lines can be found without reading the blocks
+  class BlockInfo
+  {
+  public:
+    // number of the first line which ends in this block or a later one
+    int firstLine;
+    // position of the block's first cell, counted in cells from the
+    // start of the history
+    qint64 start;
+    // position at which line firstLine starts
+    qint64 lineStart;
+  };
+
+  // finds the line's start and end positions and whether it is wrapped,
+  // returns the index of the block in which the line ends or -1 if the
+  // block is not available
+  int findLine(int lineno, qint64& start, qint64& end, bool* wrapped = 0);
+  // returns the index of the block which contains the cell at @p position,
+  // which must lie in or before the block at index @p last
+  int blockAt(qint64 position, int last) const;
+  // starts a new block after the last one
+  void appendBlock();
+
   BlockArray m_blockArray;
-  QHash<int,size_t> m_lineLengths;
+  // the blocks which are still available, oldest first.  The last one
+  // is the BlockArray's last block, which has not been written yet.
+  QList<BlockInfo> m_blocks;
+  // the BlockArray index of m_blocks.first()
+  size_t m_firstBlock;
+  // the total number of lines which have been added
+  int m_lineCount;
+  // the number of lines which have been dropped from the history
+  int m_firstLine;
+  // the position at which the next line starts
+  qint64 m_lineStart;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -338,6 +527,30 @@ protected:
   unsigned int m_nbLines;
 };
 
+class HistoryTypeCompressed : public HistoryType
+{
+public:
+  /**
+   * Fixed size histories which can hold more lines than this are
+   * stored compressed by the sessions.
+   */
+  static const int CompressionThreshold = 10000;
+
+  /**
+   * Constructs a new compressed history type which holds up to @p nbLines
+   * lines, or an unlimited number of lines if @p nbLines is 0.
+   */
+  HistoryTypeCompressed(unsigned int nbLines = 0);
+
+  virtual bool isEnabled() const;
+  virtual int maximumLineCount() const;
+
+  virtual HistoryScroll* scroll(HistoryScroll *) const;
+
+protected:
+  unsigned int m_nbLines;
+};
+
 #endif
 
 }
@@ -0,0 +1,171 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "LatencyProbe.h"
+
+// Qt
+#include <QtCore/QEvent>
+#include <QtCore/QtAlgorithms>
+
+// Konsole
+#include "Emulation.h"
+#include "EmulationThreadPool.h"
+#include "Stopwatch.h"
+#include "TerminalDisplay.h"
+
+using namespace Konsole;
+
+// number of measurements kept, older measurements are discarded
+static const int MaximumSampleCount = 1000;
+
+// measurements which have not completed after this many microseconds are
+// abandoned, the key press probably did not produce any output
+static const qint64 MaximumLatency = 1000 * 1000;
+
+LatencyProbe::LatencyProbe(Emulation* emulation , QObject* parent)
+    : QObject(parent)
+    , _emulation(emulation)
+    , _measuring(false)
+    , _lastStage(KeyPressed)
+    , _targetBytes(0)
+{
+    connect( _emulation , SIGNAL(sendData(const char*,int)) , this , SLOT(dataSent()) );
+    connect( _emulation , SIGNAL(outputChanged()) , this , SLOT(outputChanged()) );
+}
+
+void LatencyProbe::addView(TerminalDisplay* view)
+{
+    // the filter sees key presses before TerminalDisplay::keyPressEvent()
+    // passes them on to the emulation
+    view->installEventFilter(this);
+}
+
+bool LatencyProbe::eventFilter(QObject* /* watched */ , QEvent* event)
+{
+    const qint64 now = Stopwatch::currentTime();
+
+    if ( event->type() == QEvent::KeyPress )
+    {
+        // start a new measurement unless one is in progress.  A measurement
+        // whose key press has not been sent to the terminal by the time of
+        // the next key press ( eg. a modifier key ) is replaced
+        if ( !_measuring || _lastStage == KeyPressed ||
+             now - _current.time[KeyPressed] > MaximumLatency )
+        {
+            _measuring = true;
+            _lastStage = KeyPressed;
+            _current.time[KeyPressed] = now;
+        }
+    }
+    else if ( event->type() == QEvent::Paint && _measuring && _lastStage == OutputProcessed )
+    {
+        _current.time[Painted] = now;
+        finishMeasurement();
+    }
+
+    return false;
+}
+
+void LatencyProbe::dataSent()
+{
+    if ( _measuring && _lastStage == KeyPressed )
+    {
+        _current.time[DataSent] = Stopwatch::currentTime();
+        _lastStage = DataSent;
+    }
+}
+
+void LatencyProbe::outputReceived(int length)
+{
+    if ( _measuring && _lastStage == DataSent )
+    {
+        _current.time[OutputReceived] = Stopwatch::currentTime();
+        _targetBytes = EmulationThreadPool::instance()->queuedBytes(_emulation) + length;
+        _lastStage = OutputReceived;
+    }
+}
+
+void LatencyProbe::outputChanged()
+{
+    if ( _measuring && _lastStage == OutputReceived &&
+         EmulationThreadPool::instance()->processedBytes(_emulation) >= _targetBytes )
+    {
+        _current.time[OutputProcessed] = Stopwatch::currentTime();
+        _lastStage = OutputProcessed;
+    }
+}
+
+void LatencyProbe::finishMeasurement()
+{
+    _measuring = false;
+
+    if ( _current.time[Painted] - _current.time[KeyPressed] > MaximumLatency )
+        return;
+
+    // store the time spent in each stage, with the total latency in place of
+    // the time of the key press
+    Sample sample;
+    sample.time[KeyPressed] = _current.time[Painted] - _current.time[KeyPressed];
+    for ( int stage = DataSent ; stage < StageCount ; stage++ )
+        sample.time[stage] = _current.time[stage] - _current.time[stage-1];
+
+    if ( _samples.count() == MaximumSampleCount )
+        _samples.removeFirst();
+    _samples.append(sample);
+}
+
+int LatencyProbe::sampleCount() const
+{
+    return _samples.count();
+}
+
+QVariantMap LatencyProbe::statistics() const
+{
+    static const char* const stageNames[StageCount] = { "total" , "input" , "program" ,
+                                                         "emulation" , "paint" };
+
+    QVariantMap result;
+    result["samples"] = _samples.count();
+
+    if ( _samples.isEmpty() )
+        return result;
+
+    for ( int stage = 0 ; stage < StageCount ; stage++ )
+    {
+        QList<qint64> times;
+        QListIterator<Sample> iter(_samples);
+        while ( iter.hasNext() )
+            times << iter.next().time[stage];
+
+        qSort(times);
+
+        const QString name = stageNames[stage];
+        const int last = times.count() - 1;
+        result[name + "Min"] = (qlonglong)times.first();
+        result[name + "Median"] = (qlonglong)times[last / 2];
+        result[name + "P99"] = (qlonglong)times[last * 99 / 100];
+    }
+
+    return result;
+}
+
+#include "LatencyProbe.moc"
@@ -0,0 +1,134 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+// Qt
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+
+class QEvent;
+
+namespace Konsole
+{
+
+class Emulation;
+class TerminalDisplay;
+
+/**
+ * Measures the time taken between the user pressing a key in a terminal
+ * and the terminal program's response to that key appearing on screen.
+ *
+ * Each measurement is split into stages which correspond to the path
+ * taken by the key press through Konsole:
+ *
+ * <ul>
+ * <li>input - from the key press arriving at the view to the emulation
+ *     sending the resulting data to the terminal</li>
+ * <li>program - from the data being sent until the terminal program's
+ *     first output afterwards is read from the terminal</li>
+ * <li>emulation - from the output being read until the emulation has
+ *     processed it and told the views to update</li>
+ * <li>paint - from the emulation updating until a view is next painted</li>
+ * </ul>
+ *
+ * The first output read after a key is sent is assumed to be the terminal
+ * program's response to it, which is the case for typing at a shell prompt
+ * or in an editor.  Only one key press is measured at a time; keys pressed
+ * whilst a measurement is in progress are ignored.
+ */
+class LatencyProbe : public QObject
+{
+Q_OBJECT
+
+public:
+    /**
+     * Constructs a new probe which measures the latency of key presses
+     * handled by @p emulation.
+     */
+    explicit LatencyProbe(Emulation* emulation , QObject* parent = 0);
+
+    /** Starts measuring key presses in @p view, which must display the probe's emulation. */
+    void addView(TerminalDisplay* view);
+
+    /**
+     * Informs the probe that @p length bytes of output from the terminal program
+     * have been read and are about to be passed to the EmulationThreadPool
+     * for processing.
+     */
+    void outputReceived(int length);
+
+    /** Returns the number of key presses which have been measured. */
+    int sampleCount() const;
+
+    /**
+     * Returns statistics about the measured key presses.  This contains
+     * the number of measurements ( "samples" ) and, for the total latency
+     * ( "total" ) and each of the stages described above, the minimum,
+     * median and 99th percentile times in microseconds.  The keys are the
+     * name of the stage followed by Min, Median or P99, for example "totalMedian".
+     */
+    QVariantMap statistics() const;
+
+protected:
+    virtual bool eventFilter(QObject* watched , QEvent* event);
+
+private slots:
+    void dataSent();
+    void outputChanged();
+
+private:
+    enum Stage
+    {
+        KeyPressed,
+        DataSent,
+        OutputReceived,
+        OutputProcessed,
+        Painted,
+        StageCount
+    };
+
+    // times of the key press being measured reaching each stage
+    // or the number of microseconds spent in each stage of a sample
+    struct Sample
+    {
+        qint64 time[StageCount];
+    };
+
+    void finishMeasurement();
+
+    Emulation* _emulation;
+
+    bool _measuring;
+    int _lastStage;
+    Sample _current;
+    // number of bytes passed to the EmulationThreadPool which must be
+    // processed before the current key press reaches the OutputProcessed stage
+    qint64 _targetBytes;
+
+    QList<Sample> _samples;
+};
+
+}
+
+#endif // LATENCYPROBE_H
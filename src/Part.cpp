@@ -36,6 +36,7 @@
 #include "ColorScheme.h"
 #include "EditProfileDialog.h"
 #include "Emulation.h"
+#include "EmulationThreadPool.h"
 #include "KeyboardTranslator.h"
 #include "ManageProfilesDialog.h"
 #include "Session.h"
@@ -267,7 +268,10 @@ void Part::changeSessionSettings(const QString& text)
 	QByteArray buffer;
 	buffer.append("\033]50;").append(text.toUtf8()).append('\a');
 	
-	activeSession()->emulation()->receiveData(buffer.constData(),buffer.length());  
+	// the command is queued after any output which is waiting to be processed,
+	// so that it does not interrupt an escape sequence
+	EmulationThreadPool::instance()->receiveData(activeSession()->emulation(),
+												 buffer.constData(),buffer.length());
 }
 
 #include "Part.moc"
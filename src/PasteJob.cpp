@@ -0,0 +1,111 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "PasteJob.h"
+
+// Qt
+#include <QtCore/QTimer>
+
+// KDE
+#include <KLocale>
+#include <KPtyDevice>
+
+// Konsole
+#include "Emulation.h"
+#include "Pty.h"
+
+using namespace Konsole;
+
+// number of characters sent to the emulation at once
+static const int ChunkSize = 4096;
+
+// amount of data waiting to be written to the terminal, in bytes, below
+// which the next chunk is sent
+static const int MaximumPendingWrite = 16 * 1024;
+
+PasteJob::PasteJob(Emulation* emulation , Pty* pty , const QString& text , QObject* parent)
+    : KJob(parent)
+    , _emulation(emulation)
+    , _pty(pty)
+    , _text(text)
+    , _position(0)
+    , _cancelled(false)
+{
+    setCapabilities(KJob::Killable);
+}
+
+void PasteJob::start()
+{
+    emit description(this,i18n("Pasting"));
+    setTotalAmount(KJob::Bytes,_text.length());
+
+    // the terminal emits bytesWritten() each time it writes some of the data
+    // waiting to be sent to the terminal program
+    connect( _pty->pty() , SIGNAL(bytesWritten(qint64)) , this , SLOT(sendNextChunks()) );
+
+    QTimer::singleShot(0,this,SLOT(sendNextChunks()));
+}
+
+void PasteJob::appendText(const QString& text)
+{
+    _text.append(text);
+    setTotalAmount(KJob::Bytes,_text.length());
+}
+
+bool PasteJob::doKill()
+{
+    _cancelled = true;
+    disconnect( _pty->pty() , 0 , this , 0 );
+    return true;
+}
+
+void PasteJob::sendNextChunks()
+{
+    if ( _cancelled )
+        return;
+
+    while ( _position < _text.length() && _pty->pty()->bytesToWrite() < MaximumPendingWrite )
+    {
+        int length = qMin( ChunkSize , _text.length() - _position );
+
+        // avoid splitting a surrogate pair between two chunks
+        if ( _position + length < _text.length() && _text[_position+length-1].isHighSurrogate() )
+            length++;
+
+        QString chunk = _text.mid(_position,length);
+        chunk.replace("\n","\r");
+        _emulation->sendText(chunk);
+
+        _position += length;
+    }
+
+    setProcessedAmount(KJob::Bytes,_position);
+    emitPercent(_position,_text.length());
+
+    if ( _position == _text.length() )
+    {
+        disconnect( _pty->pty() , 0 , this , 0 );
+        emitResult();
+    }
+}
+
+#include "PasteJob.moc"
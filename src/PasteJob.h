@@ -0,0 +1,88 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef PASTEJOB_H
+#define PASTEJOB_H
+
+// Qt
+#include <QtCore/QString>
+
+// KDE
+#include <KJob>
+
+namespace Konsole
+{
+
+class Emulation;
+class Pty;
+
+/**
+ * Sends a large block of pasted text to a terminal in small chunks.
+ *
+ * The next chunk is only sent once the terminal program has read most of
+ * the previous one, so the application remains responsive whilst the
+ * text is being sent and the amount of text waiting to be written to the
+ * terminal stays small.  The job reports its progress through the
+ * usual KJob signals and can be cancelled using KJob::kill().
+ *
+ * As with text pasted in one go, newlines in the text are sent
+ * as carriage returns.
+ */
+class PasteJob : public KJob
+{
+Q_OBJECT
+
+public:
+    /**
+     * Constructs a new job which sends @p text to the terminal
+     * through @p emulation.  @p pty is the terminal which
+     * the emulation is connected to.
+     */
+    PasteJob(Emulation* emulation , Pty* pty , const QString& text , QObject* parent = 0);
+
+    /** Starts sending the text. */
+    virtual void start();
+
+    /**
+     * Adds @p text to the end of the text which is waiting to be sent.
+     * This is used when the user pastes again before the job has finished.
+     */
+    void appendText(const QString& text);
+
+protected:
+    virtual bool doKill();
+
+private slots:
+    // sends chunks of text until enough is waiting to be written to
+    // the terminal, or all of the text has been sent
+    void sendNextChunks();
+
+private:
+    Emulation* _emulation;
+    Pty* _pty;
+    QString _text;
+    int _position;
+    bool _cancelled;
+};
+
+}
+
+#endif // PASTEJOB_H
@@ -31,6 +31,7 @@
 
 // Qt
 #include <QtCore/QStringList>
+#include <QtCore/QTimer>
 
 // KDE
 #include <KStandardDirs>
@@ -39,8 +40,18 @@
 #include <KPty>
 #include <KPtyDevice>
 
+// Konsole
+#include "PtyCapture.h"
+#include "TraceRecorder.h"
+
 using namespace Konsole;
 
+// size of each read from the pty
+static const int ReadChunkSize = 16 * 1024;
+// maximum amount of output read in one go before returning to the event loop.
+// any remaining output is read on the next pass through the event loop
+static const int MaximumReadSize = 64 * 1024;
+
 void Pty::setWindowSize(int lines, int cols)
 {
   _windowColumns = cols;
@@ -48,6 +59,9 @@ void Pty::setWindowSize(int lines, int cols)
 
   if (pty()->masterFd() >= 0)
     pty()->setWinSize(lines, cols);
+
+  if (_capture)
+    _capture->writeResize(lines, cols);
 }
 QSize Pty::windowSize() const
 {
@@ -221,7 +235,10 @@ Pty::Pty()
       _windowLines(0),
       _eraseChar(0),
       _xonXoff(true),
-      _utf8(true)
+      _utf8(true),
+      _capture(0),
+      _readBuffer(ReadChunkSize,0),
+      _bytesRead(0)
 {
   connect(pty(), SIGNAL(readyRead()) , this , SLOT(dataReceived()));
   setPtyChannels(KPtyProcess::AllChannels);
@@ -229,6 +246,7 @@ Pty::Pty()
 
 Pty::~Pty()
 {
+  delete _capture;
 }
 
 void Pty::sendData(const char* data, int length)
@@ -245,17 +263,72 @@ void Pty::sendData(const char* data, int length)
 
 void Pty::dataReceived() 
 {
- 	QByteArray data = pty()->readAll();
-	emit receivedData(data.constData(),data.count());
+	TraceSpan span("Pty::dataReceived");
+
+	int totalRead = 0;
+
+	// read in chunks of a fixed size rather than reading everything which is
+	// available.  receivers of receivedData() may call lockPty() if they are
+	// falling behind, in which case reading stops straight away
+	while ( !pty()->isSuspended() && totalRead < MaximumReadSize )
+	{
+		const qint64 length = pty()->read(_readBuffer.data(),ReadChunkSize);
+		if ( length <= 0 )
+			return;
+
+		totalRead += length;
+		_bytesRead += length;
+
+		if (_capture)
+			_capture->writeData(_readBuffer.constData(),length);
+
+		emit receivedData(_readBuffer.constData(),length);
+	}
+
+	// readyRead() is only emitted when more output arrives, so come back
+	// for the remainder of the output which has already been buffered
+	if ( !pty()->isSuspended() && pty()->bytesAvailable() > 0 )
+		QTimer::singleShot(0,this,SLOT(dataReceived()));
+}
+
+bool Pty::setCaptureFile(const QString& fileName)
+{
+  delete _capture;
+  _capture = 0;
+
+  if (fileName.isEmpty())
+    return true;
+
+  _capture = new PtyCaptureWriter();
+  if (!_capture->open(fileName))
+  {
+    delete _capture;
+    _capture = 0;
+    return false;
+  }
+
+  // record the initial window size so that the capture is replayed
+  // into a terminal of the same size
+  _capture->writeResize(_windowLines, _windowColumns);
+
+  return true;
 }
 
 void Pty::lockPty(bool lock)
 {
-#warning "TODO: Support for locking the Pty"
-  //if (lock)
-    //suspend();
-  //else
-    //resume();
+  if ( pty()->isSuspended() == lock )
+    return;
+
+  pty()->setSuspended(lock);
+
+  // pick up the output which was buffered before reading was suspended
+  if ( !lock && pty()->bytesAvailable() > 0 )
+    QTimer::singleShot(0,this,SLOT(dataReceived()));
+}
+
+qint64 Pty::bytesRead() const
+{
+    return _bytesRead;
 }
 
 int Pty::foregroundProcessGroup() const
@@ -24,6 +24,7 @@
 #define PTY_H
 
 // Qt
+#include <QtCore/QByteArray>
 #include <QtCore/QStringList>
 #include <QtCore/QVector>
 #include <QtCore/QList>
@@ -35,6 +36,8 @@
 namespace Konsole
 {
 
+class PtyCaptureWriter;
+
 /**
  * The Pty class is used to start the terminal process, 
  * send data to it, receive data from it and manipulate 
@@ -127,6 +130,20 @@ Q_OBJECT
      * 0 will be returned.
      */
     int foregroundProcessGroup() const;
+
+    /** Returns the total number of bytes which have been read from the terminal. */
+    qint64 bytesRead() const;
+
+    /**
+     * Starts recording the data received from the terminal process
+     * and changes in the window size to the capture file @p fileName.
+     * The capture can be replayed later using PtyReplay.
+     *
+     * If @p fileName is empty, any recording in progress is stopped.
+     *
+     * Returns false if the capture file could not be opened.
+     */
+    bool setCaptureFile(const QString& fileName);
    
   public slots:
 
@@ -139,7 +156,9 @@ Q_OBJECT
      * Suspend or resume processing of data from the standard 
      * output of the terminal process.
      *
-     * See K3Process::suspend() and K3Process::resume()
+     * Whilst suspended, the pty is not read from.  Once the kernel's
+     * buffer for the pty fills up, the terminal process blocks when it
+     * next writes output, until processing is resumed.
      *
      * @param lock If true, processing of output is suspended,
      * otherwise processing is resumed.
@@ -183,6 +202,13 @@ Q_OBJECT
     char _eraseChar;
     bool _xonXoff;
     bool _utf8;
+
+    PtyCaptureWriter* _capture;
+
+    // buffer which output is read into before being passed on,
+    // allocated once and reused for each read
+    QByteArray _readBuffer;
+    qint64 _bytesRead;
 };
 
 }
@@ -0,0 +1,267 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "PtyCapture.h"
+
+// Qt
+#include <QtCore/QTimer>
+
+// KDE
+#include <KDebug>
+
+using namespace Konsole;
+
+static const char CaptureMagic[] = "KCAP";
+static const int CaptureMagicLength = 4;
+static const char CaptureVersion = 1;
+
+// maximum time spent replaying records before returning to the event loop
+// when replaying as fast as possible
+static const int FastReplayInterval = 20;
+
+PtyCaptureWriter::PtyCaptureWriter()
+{
+}
+PtyCaptureWriter::~PtyCaptureWriter()
+{
+    close();
+}
+bool PtyCaptureWriter::open(const QString& fileName)
+{
+    close();
+
+    _file.setFileName(fileName);
+    if ( !_file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    {
+        kWarning() << "Unable to open capture file" << fileName;
+        return false;
+    }
+
+    _file.write(CaptureMagic,CaptureMagicLength);
+    _file.putChar(CaptureVersion);
+    _lastRecordTime.start();
+
+    return true;
+}
+void PtyCaptureWriter::close()
+{
+    if ( _file.isOpen() )
+        _file.close();
+}
+bool PtyCaptureWriter::isOpen() const
+{
+    return _file.isOpen();
+}
+void PtyCaptureWriter::writeNumber(uint value)
+{
+    while ( value >= 0x80 )
+    {
+        _file.putChar( (char)(0x80 | (value & 0x7F)) );
+        value >>= 7;
+    }
+    _file.putChar( (char)value );
+}
+void PtyCaptureWriter::writeRecordHeader(PtyCaptureRecord::Type type)
+{
+    _file.putChar( (char)type );
+    writeNumber( _lastRecordTime.restart() );
+}
+void PtyCaptureWriter::writeData(const char* data, int length)
+{
+    if ( !_file.isOpen() )
+        return;
+
+    writeRecordHeader(PtyCaptureRecord::DataRecord);
+    writeNumber(length);
+    _file.write(data,length);
+
+    // flush each record so that the capture is complete even if
+    // Konsole does not exit normally
+    _file.flush();
+}
+void PtyCaptureWriter::writeResize(int lines, int columns)
+{
+    if ( !_file.isOpen() )
+        return;
+
+    writeRecordHeader(PtyCaptureRecord::ResizeRecord);
+    writeNumber(lines);
+    writeNumber(columns);
+    _file.flush();
+}
+
+PtyCaptureReader::PtyCaptureReader()
+{
+}
+bool PtyCaptureReader::open(const QString& fileName)
+{
+    close();
+
+    _file.setFileName(fileName);
+    if ( !_file.open(QIODevice::ReadOnly) )
+        return false;
+
+    char version = 0;
+    if ( _file.read(CaptureMagicLength) != QByteArray(CaptureMagic) ||
+         !_file.getChar(&version) || version != CaptureVersion )
+    {
+        _file.close();
+        return false;
+    }
+
+    return true;
+}
+void PtyCaptureReader::close()
+{
+    if ( _file.isOpen() )
+        _file.close();
+}
+bool PtyCaptureReader::isOpen() const
+{
+    return _file.isOpen();
+}
+bool PtyCaptureReader::readNumber(uint& value)
+{
+    value = 0;
+    for ( int shift = 0 ; shift < 32 ; shift += 7 )
+    {
+        char byte = 0;
+        if ( !_file.getChar(&byte) )
+            return false;
+
+        value |= (uint)(byte & 0x7F) << shift;
+        if ( !(byte & 0x80) )
+            return true;
+    }
+
+    return false;
+}
+bool PtyCaptureReader::readRecord(PtyCaptureRecord& record)
+{
+    char type = 0;
+    if ( !_file.isOpen() || !_file.getChar(&type) || !readNumber(record.delay) )
+        return false;
+
+    if ( type == PtyCaptureRecord::DataRecord )
+    {
+        uint length = 0;
+        if ( !readNumber(length) )
+            return false;
+
+        record.type = PtyCaptureRecord::DataRecord;
+        record.data = _file.read(length);
+        return record.data.size() == (int)length;
+    }
+    else if ( type == PtyCaptureRecord::ResizeRecord )
+    {
+        uint lines = 0;
+        uint columns = 0;
+        if ( !readNumber(lines) || !readNumber(columns) )
+            return false;
+
+        record.type = PtyCaptureRecord::ResizeRecord;
+        record.data.clear();
+        record.lines = lines;
+        record.columns = columns;
+        return true;
+    }
+
+    kWarning() << "Unknown record type in capture file" << _file.fileName();
+    return false;
+}
+
+PtyReplay::PtyReplay(QObject* parent)
+    : QObject(parent)
+    , _hasNextRecord(false)
+    , _realTime(true)
+{
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    connect( _timer , SIGNAL(timeout()) , this , SLOT(replayNextRecords()) );
+}
+bool PtyReplay::start(const QString& fileName , bool realTime)
+{
+    stop();
+
+    if ( !_reader.open(fileName) )
+        return false;
+
+    _realTime = realTime;
+    _hasNextRecord = _reader.readRecord(_nextRecord);
+    _timer->start( _realTime && _hasNextRecord ? _nextRecord.delay : 0 );
+
+    return true;
+}
+void PtyReplay::stop()
+{
+    _timer->stop();
+    _reader.close();
+    _hasNextRecord = false;
+}
+bool PtyReplay::isActive() const
+{
+    return _reader.isOpen();
+}
+void PtyReplay::replayRecord(const PtyCaptureRecord& record)
+{
+    if ( record.type == PtyCaptureRecord::DataRecord )
+        emit receivedData(record.data.constData(),record.data.size());
+    else
+        emit windowSizeChanged(record.lines,record.columns);
+}
+void PtyReplay::finish()
+{
+    _reader.close();
+    emit finished();
+}
+void PtyReplay::replayNextRecords()
+{
+    if ( _realTime )
+    {
+        if ( _hasNextRecord )
+            replayRecord(_nextRecord);
+
+        _hasNextRecord = _reader.readRecord(_nextRecord);
+        if ( _hasNextRecord )
+            _timer->start(_nextRecord.delay);
+        else
+            finish();
+
+        return;
+    }
+
+    QTime time;
+    time.start();
+
+    while ( _hasNextRecord && time.elapsed() < FastReplayInterval )
+    {
+        replayRecord(_nextRecord);
+        _hasNextRecord = _reader.readRecord(_nextRecord);
+    }
+
+    if ( _hasNextRecord )
+        _timer->start(0);
+    else
+        finish();
+}
+
+#include "PtyCapture.moc"
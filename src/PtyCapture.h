@@ -0,0 +1,209 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef PTYCAPTURE_H
+#define PTYCAPTURE_H
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QObject>
+#include <QtCore/QTime>
+
+class QTimer;
+
+namespace Konsole
+{
+
+/**
+ * A single event in a capture of the output from a terminal process.
+ *
+ * A capture file starts with the four bytes "KCAP" followed by a version byte.
+ * This is followed by a sequence of records, each of which consists of:
+ *
+ * - A type byte, either DataRecord or ResizeRecord
+ * - The time in milliseconds since the previous record
+ * - For data records, the number of bytes followed by the bytes themselves,
+ *   as received from the terminal process
+ * - For resize records, the new number of lines and columns of the window
+ *
+ * All numbers are written as variable-length unsigned integers, seven bits
+ * per byte with the least significant bits first and the top bit set in all
+ * but the last byte.
+ */
+class PtyCaptureRecord
+{
+public:
+    /** Describes the type of a record */
+    enum Type
+    {
+        /** A block of data received from the terminal process */
+        DataRecord = 0,
+        /** A change in the size of the terminal window */
+        ResizeRecord = 1
+    };
+
+    PtyCaptureRecord() : type(DataRecord) , delay(0) , lines(0) , columns(0) {}
+
+    /** The type of record */
+    Type type;
+    /** The time in milliseconds between the previous record and this one */
+    uint delay;
+    /** The data received from the terminal process, for data records */
+    QByteArray data;
+    /** The new number of lines in the window, for resize records */
+    int lines;
+    /** The new number of columns in the window, for resize records */
+    int columns;
+};
+
+/**
+ * Writes the output received from a terminal process and changes in
+ * the window size to a capture file, along with the time at which they occurred.
+ * The capture can then be replayed later using PtyReplay.
+ *
+ * See PtyCaptureRecord for a description of the file format.
+ */
+class PtyCaptureWriter
+{
+public:
+    PtyCaptureWriter();
+    ~PtyCaptureWriter();
+
+    /**
+     * Creates or truncates the capture file @p fileName and writes
+     * the header.  Returns false if the file could not be opened.
+     */
+    bool open(const QString& fileName);
+    /** Closes the capture file. */
+    void close();
+    /** Returns true if the capture file is open. */
+    bool isOpen() const;
+
+    /** Records a block of @p length bytes received from the terminal process. */
+    void writeData(const char* data, int length);
+    /** Records a change in the size of the window to @p lines by @p columns. */
+    void writeResize(int lines, int columns);
+
+private:
+    void writeRecordHeader(PtyCaptureRecord::Type type);
+    void writeNumber(uint value);
+
+    QFile _file;
+    QTime _lastRecordTime;
+};
+
+/**
+ * Reads records from a capture file written by PtyCaptureWriter.
+ */
+class PtyCaptureReader
+{
+public:
+    PtyCaptureReader();
+
+    /**
+     * Opens the capture file @p fileName.  Returns false if the file
+     * could not be opened or is not a capture file.
+     */
+    bool open(const QString& fileName);
+    /** Closes the capture file. */
+    void close();
+    /** Returns true if the capture file is open. */
+    bool isOpen() const;
+
+    /**
+     * Reads the next record from the capture into @p record.
+     * Returns false if the end of the file has been reached or
+     * the file is truncated or corrupt.
+     */
+    bool readRecord(PtyCaptureRecord& record);
+
+private:
+    bool readNumber(uint& value);
+
+    QFile _file;
+};
+
+/**
+ * Replays a capture file written by PtyCaptureWriter, emitting the
+ * same signals as a Pty would when the captured data was received.
+ *
+ * The capture can either be replayed with the delays between records
+ * which occurred when it was recorded, or as fast as possible.
+ * When replaying as fast as possible, control is returned to the event loop
+ * regularly so that views can be updated as they would be normally.
+ */
+class PtyReplay : public QObject
+{
+Q_OBJECT
+
+public:
+    /** Constructs a new replay with the specified @p parent. */
+    PtyReplay(QObject* parent = 0);
+
+    /**
+     * Starts replaying the capture file @p fileName.
+     * Returns false if the file could not be opened.
+     *
+     * @param fileName The capture file to replay
+     * @param realTime If true, the delays between records are reproduced,
+     * otherwise the records are replayed as fast as possible.
+     */
+    bool start(const QString& fileName , bool realTime);
+
+    /** Stops the replay. */
+    void stop();
+
+    /** Returns true if the replay has been started and has not yet finished. */
+    bool isActive() const;
+
+signals:
+    /**
+     * Emitted when a captured block of data is replayed.
+     *
+     * @param buffer Pointer to the data.
+     * @param length Length of @p buffer
+     */
+    void receivedData(const char* buffer, int length);
+
+    /** Emitted when a captured change in the window size is replayed. */
+    void windowSizeChanged(int lines , int columns);
+
+    /** Emitted when all the records in the capture have been replayed. */
+    void finished();
+
+private slots:
+    void replayNextRecords();
+
+private:
+    void replayRecord(const PtyCaptureRecord& record);
+    void finish();
+
+    PtyCaptureReader _reader;
+    PtyCaptureRecord _nextRecord;
+    bool _hasNextRecord;
+    bool _realTime;
+    QTimer* _timer;
+};
+
+}
+
+#endif // PTYCAPTURE_H
@@ -39,6 +39,7 @@
 // Konsole
 #include "konsole_wcwidth.h"
 #include "TerminalCharacterDecoder.h"
+#include "TraceRecorder.h"
 
 using namespace Konsole;
 
@@ -46,6 +47,13 @@ using namespace Konsole;
 //FIXME: see if we can get this from terminfo.
 #define BS_CLEARS false
 
+// number of sequences in the ExtendedCharTable which a screen can reference
+// before the first time that it checks which of them are still in use
+static const int MinimumExtendedCharsCompactionLimit = 256;
+// the minimum number of styles which a screen references before the
+// references which are no longer needed are released
+static const int MinimumStylesCompactionLimit = 256;
+
 //Macro to convert x,y position on screen to position within an image.
 //
 //Originally the image was stored as one large contiguous block of 
@@ -60,7 +68,7 @@ using namespace Konsole;
 #endif
 
 
-Character Screen::defaultChar = Character(' ',CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_FORE_COLOR),CharacterColor(COLOR_SPACE_DEFAULT,DEFAULT_BACK_COLOR),DEFAULT_RENDITION);
+Character Screen::defaultChar = Character(' ');
 
 //#define REVERSE_WRAPPED_LINES  // for wrapped line debug
 
@@ -68,8 +76,11 @@ Screen::Screen(int l, int c)
   : lines(l),
     columns(c),
     screenLines(new ImageLine[lines+1] ),
+    _generation(1),
+    _imageGeneration(1),
     _scrolledLines(0),
     _droppedLines(0),
+    _historyLinesAdded(0),
     hist(new HistoryScrollNone()),
     cuX(0), cuY(0),
     cu_re(0),
@@ -79,13 +90,26 @@ Screen::Screen(int l, int c)
     sel_busy(false),
     columnmode(false),
     ef_fg(CharacterColor()), ef_bg(CharacterColor()), ef_re(0),
+    ef_style(CharacterStyleTable::DefaultStyle),
+    ef_styleValid(true),
     sa_cuX(0), sa_cuY(0),
     sa_cu_re(0),
-    lastPos(-1)
+    lastPos(-1),
+    _extendedCharsCompactionLimit(MinimumExtendedCharsCompactionLimit),
+    _extendedCharsCompacted(true),
+    _styleCount(0),
+    _stylesCompactionLimit(MinimumStylesCompactionLimit)
 {
   lineProperties.resize(lines+1);
+  _lineSlots.resize(lines+1);
+  _lineGenerations.resize(lines+1);
   for (int i=0;i<lines+1;i++)
+  {
           lineProperties[i]=LINE_DEFAULT;
+          _lineSlots[i]=i;
+          _lineGenerations[i]=_generation;
+          screenLines[i].reserve(columns);
+  }
 
   initTabStops();
   clearSelection();
@@ -97,6 +121,14 @@ Screen::Screen(int l, int c)
 
 Screen::~Screen()
 {
+  foreach( ushort key , _extendedChars )
+      ExtendedCharTable::instance.deref(key);
+  for (int style = CharacterStyleTable::FixedStyleCount; style < _styles.size(); style++)
+  {
+      if (_styles.testBit(style))
+          CharacterStyleTable::instance()->deref(style);
+  }
+
   delete[] screenLines;
   delete[] tabstops;
   delete hist;
@@ -253,29 +285,32 @@ void Screen::deleteChars(int n)
       n = 1; 
 
   // if cursor is beyond the end of the line there is nothing to do
-  if ( cuX >= screenLines[cuY].count() )
+  if ( cuX >= screenLine(cuY).count() )
       return;
 
-  if ( cuX+n >= screenLines[cuY].count() ) 
-       n = screenLines[cuY].count() - 1 - cuX;
+  if ( cuX+n >= screenLine(cuY).count() )
+       n = screenLine(cuY).count() - 1 - cuX;
 
   Q_ASSERT( n >= 0 );
-  Q_ASSERT( cuX+n < screenLines[cuY].count() );
+  Q_ASSERT( cuX+n < screenLine(cuY).count() );
 
-  screenLines[cuY].remove(cuX,n);
+  screenLine(cuY).remove(cuX,n);
+  setLineDirty(cuY);
 }
 
 void Screen::insertChars(int n)
 {
   if (n == 0) n = 1; // Default
 
-  if ( screenLines[cuY].size() < cuX )
-    screenLines[cuY].resize(cuX);
+  if ( screenLine(cuY).size() < cuX )
+    screenLine(cuY).resize(cuX);
 
-  screenLines[cuY].insert(cuX,n,' ');
+  screenLine(cuY).insert(cuX,n,' ');
 
-  if ( screenLines[cuY].count() > columns )
-      screenLines[cuY].resize(columns);
+  if ( screenLine(cuY).count() > columns )
+      screenLine(cuY).resize(columns);
+
+  setLineDirty(cuY);
 }
 
 void Screen::deleteLines(int n)
@@ -305,6 +340,7 @@ void Screen::setMode(int m)
   switch(m)
   {
     case MODE_Origin : cuX = 0; cuY = tmargin; break; //FIXME: home
+    case MODE_Screen : setImageDirty(); break;
   }
 }
 
@@ -316,6 +352,7 @@ void Screen::resetMode(int m)
   switch(m)
   {
     case MODE_Origin : cuX = 0; cuY = 0; break; //FIXME: home
+    case MODE_Screen : setImageDirty(); break;
   }
 }
 
@@ -331,6 +368,9 @@ void Screen::saveMode(int m)
 void Screen::restoreMode(int m)
 {
   currParm.mode[m] = saveParm.mode[m];
+
+  if (m == MODE_Screen)
+    setImageDirty();
 }
 
 bool Screen::getMode(int m) const
@@ -381,6 +421,10 @@ void Screen::resizeImage(int new_lines, int new_columns)
 {
   if ((new_lines==lines) && (new_columns==columns)) return;
 
+  // the position of the last character is not valid once the lines
+  // have moved and the number of columns has changed
+  lastPos = -1;
+
   if (cuY > new_lines-1)
   { // attempt to preserve focus and lines
     bmargin = lines-1; //FIXME: margin lost
@@ -394,7 +438,7 @@ void Screen::resizeImage(int new_lines, int new_columns)
   
    ImageLine* newScreenLines = new ImageLine[new_lines+1];
    for (int i=0; i < qMin(lines-1,new_lines+1) ;i++)
-           newScreenLines[i]=screenLines[i];
+           newScreenLines[i]=screenLine(i);
    for (int i=lines;(i > 0) && (i<new_lines+1);i++)
            newScreenLines[i].resize( new_columns );
    
@@ -407,6 +451,17 @@ void Screen::resizeImage(int new_lines, int new_columns)
   delete[] screenLines; 
   screenLines = newScreenLines;
 
+  // the lines were copied in screen order
+  _lineSlots.resize(new_lines+1);
+  _lineGenerations.resize(new_lines+1);
+  for (int i=0;i<new_lines+1;i++)
+  {
+          _lineSlots[i] = i;
+          _lineGenerations[i] = _generation;
+          screenLines[i].reserve(new_columns);
+  }
+  setImageDirty();
+
   lines = new_lines;
   columns = new_columns;
   cuX = qMin(cuX,columns-1);
@@ -460,13 +515,24 @@ void Screen::setDefaultMargins()
    into RE_BOLD and RE_INTENSIVE.
 */
 
-void Screen::reverseRendition(Character& p) const
-{ 
-	CharacterColor f = p.foregroundColor; 
-	CharacterColor b = p.backgroundColor;
-  	
-	p.foregroundColor = b; 
-	p.backgroundColor = f; //p->r &= ~RE_TRANSPARENT;
+void Screen::reverseRendition(Character* dest, int count) const
+{
+  // neighbouring characters usually have the same style, so the table
+  // is only asked for the reversed style once for each run of them
+  if (count <= 0)
+    return;
+
+  quint16 lastStyle = dest[0].style;
+  quint16 reversedStyle = CharacterStyleTable::instance()->reversed(lastStyle);
+  for (int i = 0; i < count; i++)
+  {
+    if (dest[i].style != lastStyle)
+    {
+      lastStyle = dest[i].style;
+      reversedStyle = CharacterStyleTable::instance()->reversed(lastStyle);
+    }
+    dest[i].style = reversedStyle;
+  }
 }
 
 void Screen::effectiveRendition()
@@ -497,6 +563,84 @@ void Screen::effectiveRendition()
  
   if (cu_re & RE_BOLD)
     ef_fg.toggleIntensive();
+
+  // the index of the style is looked up when the next character is displayed,
+  // since a single escape sequence often changes the rendition several times
+  ef_styleValid = false;
+}
+
+void Screen::updateEffectiveStyle()
+{
+  ef_style = CharacterStyleTable::instance()->styleIndex(ef_fg,ef_bg,ef_re);
+  ef_styleValid = true;
+  useStyle(ef_style);
+}
+
+void Screen::useStyle(quint16 style)
+{
+  if (style < CharacterStyleTable::FixedStyleCount ||
+      (style < _styles.size() && _styles.testBit(style)))
+    return;
+
+  if (style >= _styles.size())
+    _styles.resize(style+1);
+
+  CharacterStyleTable::instance()->ref(style);
+  _styles.setBit(style);
+  _styleCount++;
+
+  if (_styleCount >= _stylesCompactionLimit)
+    compactStyles();
+}
+
+void Screen::compactStyles()
+{
+  // only the styles which the screen references need to be checked
+  QBitArray usedStyles(_styles.size());
+
+  // the effective style is kept since it is about to be used
+  if (ef_style < usedStyles.size())
+    usedStyles.setBit(ef_style);
+
+  for (int y = 0; y < lines; y++)
+  {
+    const ImageLine& line = screenLine(y);
+    quint16 lastStyle = ef_style;
+    for (int x = 0; x < line.size(); x++)
+    {
+      if (line[x].style != lastStyle)
+      {
+        lastStyle = line[x].style;
+        if (lastStyle < usedStyles.size())
+          usedStyles.setBit(lastStyle);
+      }
+    }
+  }
+
+  const qint64 firstHistoryLine = _historyLinesAdded - hist->getLines();
+  const int historyStyleCount = qMin(_historyStyleLines.count(),usedStyles.size());
+  for (int style = 0; style < historyStyleCount; style++)
+  {
+    if (_historyStyleLines[style] > firstHistoryLine)
+      usedStyles.setBit(style);
+  }
+
+  _styleCount = 0;
+  for (int style = CharacterStyleTable::FixedStyleCount; style < _styles.size(); style++)
+  {
+    if (!_styles.testBit(style))
+      continue;
+
+    if (usedStyles.testBit(style))
+      _styleCount++;
+    else
+    {
+      _styles.clearBit(style);
+      CharacterStyleTable::instance()->deref(style);
+    }
+  }
+
+  _stylesCompactionLimit = qMax(MinimumStylesCompactionLimit,2*_styleCount);
 }
 
 /*!
@@ -522,18 +666,6 @@ void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 
     for (int column = length; column < columns; column++) 
 		dest[destLineOffset+column] = defaultChar;
-    
-	// invert selected text
-	if (sel_begin !=-1)
-	{
-    	for (int column = 0; column < columns; column++)
-    	{
-        	if (isSelected(column,line)) 
-			{
-          		reverseRendition(dest[destLineOffset + column]); 
-    		}
-  		}
-	}
   }
 }
 
@@ -543,21 +675,13 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
 
     for (int line = startLine; line < (startLine+count) ; line++)
     {
-       int srcLineStartIndex  = line*columns;
-	   int destLineStartIndex = (line-startLine)*columns;
-
-       for (int column = 0; column < columns; column++)
-       { 
-		 int srcIndex = srcLineStartIndex + column; 
-		 int destIndex = destLineStartIndex + column;
-
-         dest[destIndex] = screenLines[srcIndex/columns].value(srcIndex%columns,defaultChar);
-
-	     // invert selected text
-         if (sel_begin != -1 && isSelected(column,line + hist->getLines()))
-           reverseRendition(dest[destIndex]); 
-       }
+       const ImageLine& sourceLine = screenLine(line);
+       const int length = qMin(columns,sourceLine.size());
+	   Character* destLine = dest + (line-startLine)*columns;
 
+       memcpy(destLine,sourceLine.constData(),length*sizeof(Character));
+       for (int column = length; column < columns; column++)
+         destLine[column] = defaultChar;
     }
 }
 
@@ -585,15 +709,36 @@ void Screen::getImage( Character* dest, int size, int startLine, int endLine ) c
  
   // invert display when in screen mode
   if (getMode(MODE_Screen))
-  {
-    for (int i = 0; i < mergedLines*columns; i++)
-      reverseRendition(dest[i]); // for reverse display
-  }
+    reverseRendition(dest,mergedLines*columns); // for reverse display
 
   // mark the character at the current cursor position
-  int cursorIndex = loc(cuX, cuY + linesInHistoryBuffer);
-  if(getMode(MODE_Cursor) && cursorIndex < columns*mergedLines)
-    dest[cursorIndex].rendition |= RE_CURSOR;
+  int cursorIndex = loc(cuX, cuY + hist->getLines() - startLine);
+  if(getMode(MODE_Cursor) && cursorIndex >= 0 && cursorIndex < columns*mergedLines)
+    dest[cursorIndex].setRendition(dest[cursorIndex].rendition() | RE_CURSOR);
+}
+
+qint64 Screen::advanceGeneration()
+{
+  return _generation++;
+}
+
+bool Screen::isLineChanged(int line , qint64 generation) const
+{
+  if (_imageGeneration > generation)
+    return true;
+
+  // lines in the history only change when the whole image does
+  const int y = line - hist->getLines();
+  if (y < 0)
+    return false;
+
+  return _lineGenerations[y] > generation;
+}
+
+void Screen::setLinesDirty(int top , int bottom)
+{
+  for (int y = top; y <= bottom; y++)
+    _lineGenerations[y] = _generation;
 }
 
 QVector<LineProperty> Screen::getLineProperties( int startLine , int endLine ) const
@@ -667,10 +812,14 @@ void Screen::BackSpace()
   cuX = qMax(0,cuX-1);
  // if (BS_CLEARS) image[loc(cuX,cuY)].character = ' ';
 
-  if (screenLines[cuY].size() < cuX+1)
-          screenLines[cuY].resize(cuX+1);
+  if (screenLine(cuY).size() < cuX+1)
+          screenLine(cuY).resize(cuX+1);
 
-  if (BS_CLEARS) screenLines[cuY][cuX].character = ' ';
+  if (BS_CLEARS)
+  {
+    screenLine(cuY)[cuX].character = ' ';
+    setLineDirty(cuY);
+  }
 }
 
 void Screen::Tabulate(int n)
@@ -755,12 +904,20 @@ void Screen::ShowCharacter(unsigned short c)
 
   int w = konsole_wcwidth(c);
 
+  if (!ef_styleValid)
+      updateEffectiveStyle();
+
   if (w <= 0)
+  {
+     if (w == 0 && c != 0)
+         compose(c);
      return;
+  }
 
   if (cuX+w > columns) {
     if (getMode(MODE_Wrap)) {
       lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | LINE_WRAPPED);
+      setLineDirty(cuY);
       NextLine();
     }
     else
@@ -768,32 +925,31 @@ void Screen::ShowCharacter(unsigned short c)
   }
 
   // ensure current line vector has enough elements
-  int size = screenLines[cuY].size();
+  int size = screenLine(cuY).size();
   if (size == 0 && cuY > 0)
   {
-          screenLines[cuY].resize( qMax(screenLines[cuY-1].size() , cuX+w) );
+          screenLine(cuY).resize( qMax(screenLine(cuY-1).size() , cuX+w) );
   }
   else
   {
     if (size < cuX+w)
     {
-          screenLines[cuY].resize(cuX+w);
+          screenLine(cuY).resize(cuX+w);
     }
   }
 
   if (getMode(MODE_Insert)) insertChars(w);
 
   lastPos = loc(cuX,cuY);
+  setLineDirty(cuY);
 
   // check if selection is still valid.
   checkSelection(cuX,cuY);
 
-  Character& currentChar = screenLines[cuY][cuX];
+  Character& currentChar = screenLine(cuY)[cuX];
 
   currentChar.character = c;
-  currentChar.foregroundColor = ef_fg;
-  currentChar.backgroundColor = ef_bg;
-  currentChar.rendition = ef_re;
+  currentChar.style = ef_style;
 
   int i = 0;
   int newCursorX = cuX + w--;
@@ -801,31 +957,271 @@ void Screen::ShowCharacter(unsigned short c)
   {
      i++;
    
-     if ( screenLines[cuY].size() < cuX + i + 1 )
-         screenLines[cuY].resize(cuX+i+1);
+     if ( screenLine(cuY).size() < cuX + i + 1 )
+         screenLine(cuY).resize(cuX+i+1);
      
-     Character& ch = screenLines[cuY][cuX + i];
+     Character& ch = screenLine(cuY)[cuX + i];
      ch.character = 0;
-     ch.foregroundColor = ef_fg;
-     ch.backgroundColor = ef_bg;
-     ch.rendition = ef_re;
+     ch.style = ef_style;
 
      w--;
   }
   cuX = newCursorX;
 }
 
-void Screen::compose(const QString& /*compose*/)
+void Screen::displayCharacters(const unsigned short* chars, int count)
 {
-   Q_ASSERT( 0 /*Not implemented yet*/ );
+  if (!ef_styleValid)
+      updateEffectiveStyle();
+
+  int i = 0;
 
-/*  if (lastPos == -1)
+  while (i < count)
+  {
+    int w = konsole_wcwidth(chars[i]);
+
+    if (w <= 0)
+    {
+       if (w == 0 && chars[i] != 0)
+           compose(chars[i]);
+       i++;
+       continue;
+    }
+
+    // wrap before putting the first character of the segment, as in ShowCharacter()
+    if (cuX+w > columns) {
+      if (getMode(MODE_Wrap)) {
+        lineProperties[cuY] = (LineProperty)(lineProperties[cuY] | LINE_WRAPPED);
+        setLineDirty(cuY);
+        NextLine();
+      }
+      else
+        cuX = columns-w;
+    }
+
+    // find the longest segment of the run which fits onto the rest of the current line
+    int end = i+1;
+    int segmentWidth = w;
+    while (end < count)
+    {
+      int charWidth = konsole_wcwidth(chars[end]);
+      if (charWidth > 0 && cuX+segmentWidth+charWidth > columns)
+          break;
+      if (charWidth > 0)
+          segmentWidth += charWidth;
+      end++;
+    }
+
+    // ensure current line vector has enough elements
+    ImageLine& line = screenLine(cuY);
+    int size = line.size();
+    if (size == 0 && cuY > 0)
+    {
+          line.resize( qMax(screenLine(cuY-1).size() , cuX+segmentWidth) );
+    }
+    else
+    {
+      if (size < cuX+segmentWidth)
+      {
+          line.resize(cuX+segmentWidth);
+      }
+    }
+
+    if (getMode(MODE_Insert)) insertChars(segmentWidth);
+
+    setLineDirty(cuY);
+
+    // check if selection is still valid.
+    checkSelection(loc(cuX,cuY),loc(cuX+segmentWidth,cuY));
+
+    Character* data = line.data();
+    for (; i < end; i++)
+    {
+      int charWidth = konsole_wcwidth(chars[i]);
+      if (charWidth <= 0)
+      {
+          if (charWidth == 0 && chars[i] != 0)
+              compose(chars[i]);
+          continue;
+      }
+
+      lastPos = loc(cuX,cuY);
+
+      Character& currentChar = data[cuX];
+      currentChar.character = chars[i];
+      currentChar.style = ef_style;
+
+      // the remaining cells covered by a wide character are left blank
+      for (int j = 1; j < charWidth; j++)
+      {
+        Character& ch = data[cuX+j];
+        ch.character = 0;
+        ch.style = ef_style;
+      }
+
+      cuX += charWidth;
+    }
+  }
+}
+
+void Screen::compose(unsigned short c)
+{
+  if (lastPos == -1)
      return;
-     
-  QChar c(image[lastPos].character);
-  compose.prepend(c);
-  //compose.compose(); ### FIXME!
-  image[lastPos].character = compose[0].unicode();*/
+
+  const int y = lastPos / columns;
+  if (y >= lines)
+     return;
+
+  ImageLine& line = screenLine(y);
+  int x = lastPos % columns;
+  if (x >= line.size())
+     return;
+
+  Character& base = line[x];
+  ExtendedCharTable& table = ExtendedCharTable::instance;
+
+  // build up the new sequence on the stack, it is only copied if it is not
+  // already in the table
+  ushort sequence[ExtendedCharTable::MaximumSequenceLength];
+  ushort length = 0;
+  if (base.rendition() & RE_EXTENDED_CHAR)
+     length = table.lookupExtendedChar(base.charSequence,sequence);
+  else
+     sequence[length++] = base.character;
+
+  if (length == 0 || length == ExtendedCharTable::MaximumSequenceLength)
+     return;
+
+  sequence[length++] = c;
+
+  ushort key = table.createExtendedChar(sequence,length);
+  if (key == 0 && !_extendedCharsCompacted)
+  {
+     // the table is full, release the sequences which are no longer used
+     // by this screen and try again
+     compactExtendedChars();
+     key = table.createExtendedChar(sequence,length);
+  }
+  if (key == 0)
+     return;
+
+  base.charSequence = key;
+  base.setRendition(base.rendition() | RE_EXTENDED_CHAR);
+  useStyle(base.style);
+  setLineDirty(y);
+
+  // the screen holds a single reference on each sequence which it uses
+  if (_extendedChars.contains(key))
+  {
+     table.deref(key);
+  }
+  else
+  {
+     _extendedChars.insert(key);
+     _extendedCharsCompacted = false;
+     if (_extendedChars.count() >= _extendedCharsCompactionLimit)
+        compactExtendedChars();
+  }
+}
+
+void Screen::addHistoryLine(const Character* cells, int count)
+{
+  HistoryExtendedChars lineChars;
+  lineChars.line = _historyLinesAdded;
+
+  quint16 lastStyle = CharacterStyleTable::DefaultStyle;
+  bool extended = false;
+  for (int x = 0; x < count; x++)
+  {
+    if (cells[x].style != lastStyle)
+    {
+      lastStyle = cells[x].style;
+      extended = cells[x].rendition() & RE_EXTENDED_CHAR;
+
+      if (lastStyle >= CharacterStyleTable::FixedStyleCount)
+      {
+        if (lastStyle >= _historyStyleLines.count())
+          _historyStyleLines.resize(lastStyle+1);
+        _historyStyleLines[lastStyle] = _historyLinesAdded + 1;
+      }
+    }
+    if (extended && !lineChars.keys.contains(cells[x].charSequence))
+      lineChars.keys << cells[x].charSequence;
+  }
+
+  if (lineChars.keys.isEmpty())
+    return;
+
+  foreach( ushort key , lineChars.keys )
+    _historyExtendedCharCounts[key]++;
+  _historyExtendedChars << lineChars;
+}
+
+void Screen::removeDroppedHistoryExtendedChars()
+{
+  // the history holds the most recently added lines, any lines added
+  // before those have been dropped from it
+  const qint64 firstLine = _historyLinesAdded - hist->getLines();
+
+  while (!_historyExtendedChars.isEmpty() &&
+         _historyExtendedChars.first().line < firstLine)
+  {
+    foreach( ushort key , _historyExtendedChars.first().keys )
+    {
+      if (--_historyExtendedCharCounts[key] == 0)
+        _historyExtendedCharCounts.remove(key);
+    }
+    _historyExtendedChars.removeFirst();
+  }
+}
+
+void Screen::compactExtendedChars()
+{
+  QSet<ushort> usedChars;
+
+  // the rendition of consecutive characters is usually the same,
+  // so it is only looked up when the style changes
+  quint16 lastStyle = CharacterStyleTable::DefaultStyle;
+  bool extended = false;
+
+  for (int y = 0; y < lines; y++)
+  {
+    const ImageLine& line = screenLine(y);
+    for (int x = 0; x < line.size(); x++)
+    {
+      const Character& ch = line[x];
+      if (ch.style != lastStyle)
+      {
+        lastStyle = ch.style;
+        extended = ch.rendition() & RE_EXTENDED_CHAR;
+      }
+      if (extended && _extendedChars.contains(ch.charSequence))
+        usedChars.insert(ch.charSequence);
+    }
+  }
+
+  // the sequences used by the history are counted as lines are added to it,
+  // so that it does not have to be read back here
+  removeDroppedHistoryExtendedChars();
+  foreach( ushort key , _extendedChars )
+  {
+    if (_historyExtendedCharCounts.contains(key))
+      usedChars.insert(key);
+  }
+
+  // sequences which have scrolled out of the history or been overwritten
+  // are released
+  foreach( ushort key , _extendedChars )
+  {
+    if (!usedChars.contains(key))
+        ExtendedCharTable::instance.deref(key);
+  }
+  _extendedChars = usedChars;
+  _extendedCharsCompacted = true;
+
+  _extendedCharsCompactionLimit = qMax(MinimumExtendedCharsCompactionLimit,
+                                       2*_extendedChars.count());
 }
 
 int Screen::scrolledLines() const
@@ -840,6 +1236,10 @@ void Screen::resetDroppedLines()
 {
     _droppedLines = 0;
 }
+qint64 Screen::historyLinesAdded() const
+{
+    return _historyLinesAdded;
+}
 void Screen::resetScrolledLines()
 {
     //kDebug() << "scrolled lines reset";
@@ -868,6 +1268,8 @@ QRect Screen::lastScrolledRegion() const
 
 void Screen::scrollUp(int from, int n)
 {
+  TraceSpan span("Screen::scrollUp");
+
   if (n <= 0 || from + n > bmargin) return;
 
   _scrolledLines -= n;
@@ -976,6 +1378,8 @@ void Screen::clearImage(int loca, int loce, char c)
   int topLine = loca/columns;
   int bottomLine = loce/columns;
 
+  setLinesDirty(topLine,bottomLine);
+
   Character clearCh(c,cu_fg,cu_bg,DEFAULT_RENDITION);
   
   //if the character being used to clear the area is the same as the
@@ -989,7 +1393,7 @@ void Screen::clearImage(int loca, int loce, char c)
         int endCol = ( y == bottomLine) ? loce%columns : columns-1;
         int startCol = ( y == topLine ) ? loca%columns : 0;
 
-        QVector<Character>& line = screenLines[y];
+        QVector<Character>& line = screenLine(y);
 
         if ( isDefaultCh && endCol == columns-1 )
         {
@@ -997,7 +1401,10 @@ void Screen::clearImage(int loca, int loce, char c)
         }
         else
         {
-            if (line.size() < endCol + 1)
+            // lines can be longer than the screen is wide after it has
+            // been made narrower, discard the rest of the line if it
+            // is being cleared up to the right edge
+            if (line.size() < endCol + 1 || endCol == columns-1)
                 line.resize(endCol+1);
 
             Character* data = line.data();
@@ -1005,6 +1412,8 @@ void Screen::clearImage(int loca, int loce, char c)
                 data[i]=clearCh;
         }
   }
+
+  useStyle(clearCh.style);
 }
 
 /*! move image between (including) `sourceBegin' and `sourceEnd' to 'dest'.
@@ -1030,26 +1439,30 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
   int lines=(sourceEnd-sourceBegin)/columns;
 
   //move screen image and line properties:
-  //the source and destination areas of the image may overlap, 
-  //so it matters that we do the copy in the right order - 
-  //forwards if dest < sourceBegin or backwards otherwise.
-  //(search the web for 'memmove implementation' for details)
-  if (dest < sourceBegin)
+  //rather than copying the lines, the slots which hold the lines in the area
+  //covered by the source and destination are rotated.  the lines which
+  //are not overwritten by the move end up in the part of the area which
+  //the source has been moved away from.  callers clear those lines afterwards
+  const int destLine = dest/columns;
+  const int sourceLine = sourceBegin/columns;
+  const int top = qMin(destLine,sourceLine);
+  const int count = qAbs(destLine-sourceLine) + lines + 1;
+  const int shift = destLine-sourceLine+count;
+
+  QVarLengthArray<int,64> rotatedSlots(count);
+  QVarLengthArray<LineProperty,64> rotatedProperties(count);
+  for (int i=0;i<count;i++)
   {
-    for (int i=0;i<=lines;i++)
-    {
-        screenLines[ (dest/columns)+i ] = screenLines[ (sourceBegin/columns)+i ];
-        lineProperties[(dest/columns)+i]=lineProperties[(sourceBegin/columns)+i];
-    }
+    const int target = (i+shift) % count;
+    rotatedSlots[target] = _lineSlots[top+i];
+    rotatedProperties[target] = lineProperties[top+i];
   }
-  else
+  for (int i=0;i<count;i++)
   {
-    for (int i=lines;i>=0;i--)
-    {
-        screenLines[ (dest/columns)+i ] = screenLines[ (sourceBegin/columns)+i ];
-        lineProperties[(dest/columns)+i]=lineProperties[(sourceBegin/columns)+i];
-    }
+    _lineSlots[top+i] = rotatedSlots[i];
+    lineProperties[top+i] = rotatedProperties[i];
   }
+  setLinesDirty(top,top+count-1);
 
   if (lastPos != -1)
   {
@@ -1394,10 +1807,10 @@ int Screen::copyLineToStream(int line ,
 
             assert( count >= 0 );
 
-            const int screenLine = line-hist->getLines();
+            const int screenLineIndex = line-hist->getLines();
 
-            Character* data = screenLines[screenLine].data();
-            int length = screenLines[screenLine].count();
+            Character* data = screenLine(screenLineIndex).data();
+            int length = screenLine(screenLineIndex).count();
 
 			// ignore trailing white space at the end of the line
 			for (int i = length-1; i >= 0; i--)
@@ -1415,8 +1828,8 @@ int Screen::copyLineToStream(int line ,
             // count cannot be any greater than length
 			count = qBound(0,count,length-start);
 
-            Q_ASSERT( screenLine < lineProperties.count() );
-            currentLineProperties |= lineProperties[screenLine]; 
+            Q_ASSERT( screenLineIndex < lineProperties.count() );
+            currentLineProperties |= lineProperties[screenLineIndex];
 		}
 
         // add new line character at end
@@ -1470,6 +1883,8 @@ QString Screen::getHistoryLine(int no)
 
 void Screen::addHistLine()
 {
+  TraceSpan span("Screen::addHistLine");
+
   // add line to history buffer
   // we have to take care about scrolling, too...
 
@@ -1477,8 +1892,31 @@ void Screen::addHistLine()
   {
     int oldHistLines = hist->getLines();
 
-    hist->addCellsVector(screenLines[0]);
-    hist->addLine( lineProperties[0] & LINE_WRAPPED );
+    const ImageLine& line = screenLine(0);
+    const bool wrapped = lineProperties[0] & LINE_WRAPPED;
+
+    // blanks at the end of the line are not stored since they are filled
+    // in again when the line is read back from the history.  They are
+    // kept in wrapped lines, where they are part of the text.
+    int length = line.count();
+    if (!wrapped)
+    {
+      while (length > 0 && line[length-1] == defaultChar)
+        length--;
+    }
+
+    if (length == line.count())
+      hist->addCellsVector(line);
+    else
+      hist->addCells(line.constData(),length);
+    hist->addLine(wrapped);
+    addHistoryLine(line.constData(),length);
+    _historyLinesAdded++;
+    removeDroppedHistoryExtendedChars();
+
+    // the lines in the history move up by one or change
+    // their position relative to the screen
+    setImageDirty();
 
     int newHistLines = hist->getLines();
 
@@ -1537,6 +1975,7 @@ int Screen::getHistLines()
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
   clearSelection();
+  setImageDirty();
 
   if ( copyPreviousScroll )
     hist = t.scroll(hist);
@@ -1568,6 +2007,7 @@ void Screen::setLineProperty(LineProperty property , bool enable)
 	{
 		lineProperties[cuY] = (LineProperty)(lineProperties[cuY] & ~property);
 	}
+	setLineDirty(cuY);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
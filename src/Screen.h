@@ -24,7 +24,11 @@
 #define SCREEN_H
 
 // Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
 #include <QtCore/QRect>
+#include <QtCore/QSet>
 #include <QtCore/QTextStream>
 #include <QtCore/QVarLengthArray>
 
@@ -72,8 +76,8 @@ class TerminalCharacterDecoder;
 
     The screen image has a selection associated with it, specified using 
     setSelectionStart() and setSelectionEnd().  The selected text can be retrieved
-    using selectedText().  When getImage() is used to retrieve the the visible image,
-    characters which are part of the selection have their colours inverted.   
+    using selectedText().  The selection is not part of the image returned by
+    getImage(), views draw it over the image themselves.
 */
 class Screen
 {
@@ -340,9 +344,29 @@ public:
      * character already at the current cursor position.  
      */ 
     void ShowCharacter(unsigned short c);
+
+    /**
+     * Displays a run of @p count characters starting at the current cursor position.
+     *
+     * This has the same effect as calling ShowCharacter() for each character in 
+     * @p chars in turn, but the line storage is resized, the insert mode is applied
+     * and the selection is checked once for each line which the run touches rather 
+     * than once per character.  
+     *
+     * The characters must already have been mapped through the current character set
+     * and must not contain any control characters.
+     */
+    void displayCharacters(const unsigned short* chars, int count);
     
-    // Do composition with last shown character FIXME: Not implemented yet for KDE 4
-    void compose(const QString& compose);
+    /**
+     * Appends the combining character @p c to the last character which was
+     * displayed, so that both are drawn in the same cell.  The sequence of
+     * characters in the cell is stored in the ExtendedCharTable.
+     *
+     * This is called by ShowCharacter() and displayCharacters() for
+     * characters which have a width of zero.
+     */
+    void compose(unsigned short c);
     
     /** 
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.  
@@ -374,6 +398,21 @@ public:
      * other attributes control the size of characters in the line.
      */
     QVector<LineProperty> getLineProperties( int startLine , int endLine ) const;
+
+    /**
+     * Ends the current generation of changes to the screen and returns its
+     * number.  Changes made after this call belong to the next generation.
+     *
+     * Together with isLineChanged(), this allows a view onto the screen to
+     * copy only the lines which have changed since it last called getImage().
+     */
+    qint64 advanceGeneration();
+    /**
+     * Returns true if the line @p line, where lines are numbered as in getImage(),
+     * may have changed since generation @p generation was returned by
+     * advanceGeneration().
+     */
+    bool isLineChanged(int line , qint64 generation) const;
 	
 
     /** Return the number of lines. */
@@ -428,6 +467,11 @@ public:
     /** Clears the current selection */
     void clearSelection();
 
+    /** Returns true if there is a selection. */
+    bool isSelectionValid() const;
+    /** Returns true if the current selection is a column ( block ) selection. */
+    bool isColumnSelection() const { return columnmode; }
+
     void setBusySelecting(bool busy) { sel_busy = busy; }
 
     /** 
@@ -531,6 +575,12 @@ public:
      */
     void resetDroppedLines();
 
+    /**
+     * Returns the total number of lines which have been added
+     * to the history since the screen was created.
+     */
+    qint64 historyLinesAdded() const;
+
 	/** 
  	 * Fills the buffer @p dest with @p count instances of the default (ie. blank)
  	 * Character style.
@@ -575,9 +625,26 @@ private:
     void initTabStops();
 
     void effectiveRendition();
-    void reverseRendition(Character& p) const;
-
-    bool isSelectionValid() const;
+    // looks up the index of the effective colors and rendition in the CharacterStyleTable
+    void updateEffectiveStyle();
+    // replaces the styles of 'count' characters in 'dest' with their reversed styles
+    void reverseRendition(Character* dest, int count) const;
+
+    // releases the references held on sequences in the ExtendedCharTable
+    // which are no longer used by the screen or its history
+    void compactExtendedChars();
+    // records the sequences and styles which are used by a line added
+    // to the history
+    void addHistoryLine(const Character* cells, int count);
+    // forgets the sequences used by lines which are no longer in the history
+    void removeDroppedHistoryExtendedChars();
+
+    // adds a reference to a style in the CharacterStyleTable which is
+    // stored in the screen
+    void useStyle(quint16 style);
+    // releases the references held on styles which are no longer used by
+    // the screen or its history
+    void compactStyles();
 
 	// copies 'count' lines from the screen buffer into 'dest',
 	// starting from 'startLine', where 0 is the first line in the screen buffer
@@ -592,12 +659,36 @@ private:
     int columns;
 
     typedef QVector<Character> ImageLine;      // [0..columns]
-    ImageLine*          screenLines;    // [lines]
+    ImageLine*          screenLines;    // [lines], indexed by _lineSlots
+
+    // the slot in screenLines which holds each line of the screen.  scrolling
+    // rotates the slot numbers instead of moving the lines themselves, so the
+    // lines keep their buffers rather than being reallocated as they move
+    QVarLengthArray<int,64> _lineSlots;
+
+    // returns the line of the screen image at 'y'
+    ImageLine& screenLine(int y) { return screenLines[_lineSlots[y]]; }
+    const ImageLine& screenLine(int y) const { return screenLines[_lineSlots[y]]; }
+
+    // dirty line tracking, see advanceGeneration() and isLineChanged()
+    qint64 _generation;
+    // the generation in which each line of the screen image last changed
+    QVarLengthArray<qint64,64> _lineGenerations;
+    // the generation in which the whole image, including the history,
+    // last changed
+    qint64 _imageGeneration;
+
+    // record that the line 'y' , the lines from 'top' to 'bottom' or
+    // the whole image have changed
+    void setLineDirty(int y) { _lineGenerations[y] = _generation; }
+    void setLinesDirty(int top , int bottom);
+    void setImageDirty() { _imageGeneration = _generation; }
 
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    qint64 _historyLinesAdded;
 
     QVarLengthArray<LineProperty,64> lineProperties;    
 	
@@ -635,6 +726,8 @@ private:
     CharacterColor ef_fg;      // These are derived from
     CharacterColor ef_bg;      // the cu_* variables above
     quint8 ef_re;      // to speed up operation
+    quint16 ef_style;  // index of ef_fg, ef_bg and ef_re in the CharacterStyleTable
+    bool ef_styleValid; // false if ef_style needs updating, see updateEffectiveStyle()
 
     //
     // save cursor, rendition & states ------------
@@ -652,6 +745,42 @@ private:
     // last position where we added a character
     int lastPos;
 
+    // keys of the sequences in the ExtendedCharTable which this screen
+    // holds a reference to
+    QSet<ushort> _extendedChars;
+    // number of referenced sequences above which compactExtendedChars()
+    // is called
+    int _extendedCharsCompactionLimit;
+    // true if no sequences have been referenced since the last call to
+    // compactExtendedChars()
+    bool _extendedCharsCompacted;
+
+    // the sequences used by a line in the history
+    class HistoryExtendedChars
+    {
+    public:
+        // the value of _historyLinesAdded when the line was added
+        qint64 line;
+        QVector<ushort> keys;
+    };
+    // the lines in the history which use sequences, oldest first
+    QList<HistoryExtendedChars> _historyExtendedChars;
+    // number of lines in _historyExtendedChars which use each sequence
+    QHash<ushort,int> _historyExtendedCharCounts;
+
+    // the styles in the CharacterStyleTable which this screen holds a
+    // reference to, indexed by style.  the array is only as large as
+    // the highest referenced style
+    QBitArray _styles;
+    int _styleCount;
+    // number of referenced styles above which compactStyles() is called
+    int _stylesCompactionLimit;
+    // one more than the value of _historyLinesAdded when each style was
+    // last used by a line added to the history, or 0 if it has not been
+    // used.  the style is still used by the history if that line has not
+    // been dropped from it yet
+    QVector<qint64> _historyStyleLines;
+
     // modes
     ScreenParm saveParm;
 
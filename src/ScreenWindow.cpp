@@ -21,33 +21,109 @@
 #include "ScreenWindow.h"
 
 // Qt
+#include <QtCore/QMutexLocker>
+
+// KDE
 #include <KDebug>
 
 // Konsole
 #include "Screen.h"
+#include "TraceRecorder.h"
 
 using namespace Konsole;
 
+// the minimum number of styles which a window holds a reference to before
+// it releases those which are no longer used by its image
+static const int MinimumStylesCompactionLimit = 256;
+
+SelectionRange::SelectionRange()
+    : _columnMode(false)
+    , _empty(true)
+{
+}
+
+SelectionRange::SelectionRange(const QPoint& start , const QPoint& end , bool columnMode)
+    : _start(start)
+    , _end(end)
+    , _columnMode(columnMode)
+    , _empty(false)
+{
+}
+
+bool SelectionRange::selectedColumns(int line , int columns , int& left , int& right) const
+{
+    if ( _empty || line < _start.y() || line > _end.y() )
+        return false;
+
+    if ( _columnMode )
+    {
+        left = _start.x();
+        right = _end.x();
+    }
+    else
+    {
+        left = ( line == _start.y() ) ? _start.x() : 0;
+        right = ( line == _end.y() ) ? _end.x() : columns-1;
+    }
+
+    return left <= right;
+}
+
+bool SelectionRange::operator==(const SelectionRange& other) const
+{
+    if ( _empty || other._empty )
+        return _empty == other._empty;
+
+    return _start == other._start && _end == other._end &&
+           _columnMode == other._columnMode;
+}
+
 ScreenWindow::ScreenWindow(QObject* parent)
     : QObject(parent)
 	, _windowBuffer(0)
 	, _windowBufferSize(0)
 	, _bufferNeedsUpdate(true)
+	, _imageScreen(0)
+	, _imageLine(0)
+	, _imageLineCount(0)
+	, _screenGeneration(0)
+	, _imageCursorLine(0)
+	, _imageGeneration(0)
+	, _styleCount(0)
+	, _stylesCompactionLimit(MinimumStylesCompactionLimit)
 	, _windowLines(1)
+    , _screenLock(0)
     , _currentLine(0)
     , _trackOutput(true)
+    , _visible(true)
     , _scrollCount(0)
 {
 }
 ScreenWindow::~ScreenWindow()
 {
 	delete[] _windowBuffer;
+
+	for (int style = CharacterStyleTable::FixedStyleCount; style < _styles.size(); style++)
+	{
+		if (_styles.testBit(style))
+			CharacterStyleTable::instance()->deref(style);
+	}
 }
 void ScreenWindow::setScreen(Screen* screen)
 {
     Q_ASSERT( screen );
 
+    QMutexLocker locker(_screenLock);
     _screen = screen;
+
+    // the previous screen may be deleted and another created at the same
+    // address, so the next image is always taken from scratch
+    _imageScreen = 0;
+}
+
+void ScreenWindow::setScreenLock(QMutex* lock)
+{
+    _screenLock = lock;
 }
 
 Screen* ScreenWindow::screen() const
@@ -57,6 +133,10 @@ Screen* ScreenWindow::screen() const
 
 Character* ScreenWindow::getImage()
 {
+	TraceSpan span("ScreenWindow::getImage");
+
+	QMutexLocker locker(_screenLock);
+
 	// reallocate internal buffer if the window size has changed
 	int size = windowLines() * windowColumns();
 	if (_windowBuffer == 0 || _windowBufferSize != size) 
@@ -65,23 +145,193 @@ Character* ScreenWindow::getImage()
 		_windowBufferSize = size;
 		_windowBuffer = new Character[size];
 		_bufferNeedsUpdate = true;
+		_imageScreen = 0;
+	}
+
+	// take the selection at the same time as the image, so that the two match
+	// when the selection is drawn over the image
+	if (_screen->isSelectionValid())
+	{
+		int startColumn , startLine , endColumn , endLine;
+		_screen->getSelectionStart(startColumn,startLine);
+		_screen->getSelectionEnd(endColumn,endLine);
+
+		QPoint start(startColumn,startLine - currentLine());
+		QPoint end(endColumn,endLine - currentLine());
+
+		// the corners of a column selection can be in either order
+		if (_screen->isColumnSelection())
+		{
+			start.setX( qMin(startColumn,endColumn) );
+			end.setX( qMax(startColumn,endColumn) );
+		}
+		_imageSelection = SelectionRange(start,end,_screen->isColumnSelection());
+	}
+	else
+	{
+		_imageSelection = SelectionRange();
 	}
 
 	 if (!_bufferNeedsUpdate)
 		return _windowBuffer;
+
+	// the whole image is copied if the window has moved or now looks onto a
+	// different screen, otherwise only the lines which have changed since
+	// the last image was taken and the lines which the cursor has moved
+	// from or to are copied
+	const bool updateAll = _imageScreen != _screen ||
+						   _imageLine != currentLine() ||
+						   _imageLineCount != lineCount() ||
+						   _lineGenerations.count() != windowLines();
+	const int newCursorLine = cursorLine();
+	const qint64 screenGeneration = _screen->advanceGeneration();
+
+	_imageGeneration++;
+	_lineGenerations.resize(windowLines());
  
-	_screen->getImage(_windowBuffer,size,
-					  currentLine(),endWindowLine());
+	if (updateAll)
+	{
+		_screen->getImage(_windowBuffer,size,
+						  currentLine(),endWindowLine());
+		useStyles(_windowBuffer,size);
+
+		// this window may look beyond the end of the screen, in which
+		// case there will be an unused area which needs to be filled
+		// with blank characters
+		fillUnusedArea();
+
+		_lineGenerations.fill(_imageGeneration);
+	}
+	else
+	{
+		const int columns = windowColumns();
+		const int lastLine = endWindowLine() - currentLine();
+
+		for (int line = 0; line <= lastLine; line++)
+		{
+			if (line == _imageCursorLine || line == newCursorLine ||
+				_screen->isLineChanged(currentLine() + line,_screenGeneration))
+			{
+				_screen->getImage(_windowBuffer + line*columns,columns,
+								  currentLine() + line,currentLine() + line);
+				useStyles(_windowBuffer + line*columns,columns);
+				_lineGenerations[line] = _imageGeneration;
+			}
+		}
+	}
 
-	// this window may look beyond the end of the screen, in which 
-	// case there will be an unused area which needs to be filled
-	// with blank characters
-	fillUnusedArea();
+	_imageScreen = _screen;
+	_imageLine = currentLine();
+	_imageLineCount = lineCount();
+	_screenGeneration = screenGeneration;
+	_imageCursorLine = newCursorLine;
+
+	// take the cursor position at the same time as the image, so that
+	// the two match even if more output is processed before the cursor is drawn
+	_cursorPosition = QPoint( _screen->getCursorX() , _screen->getCursorY() );
+
+	if (_styleCount >= _stylesCompactionLimit)
+		compactStyles();
 
 	_bufferNeedsUpdate = false;
 	return _windowBuffer;
 }
 
+void ScreenWindow::useStyles(const Character* cells , int count)
+{
+	quint16 lastStyle = CharacterStyleTable::DefaultStyle;
+	for (int i = 0; i < count; i++)
+	{
+		const quint16 style = cells[i].style;
+		if (style == lastStyle || style < CharacterStyleTable::FixedStyleCount)
+			continue;
+		lastStyle = style;
+
+		if (style >= _styles.size())
+		{
+			_styles.resize(style+1);
+			_copiedStyles.resize(style+1);
+		}
+
+		_copiedStyles.setBit(style);
+		if (!_styles.testBit(style))
+		{
+			CharacterStyleTable::instance()->ref(style);
+			_styles.setBit(style);
+			_styleCount++;
+		}
+	}
+}
+
+void ScreenWindow::compactStyles()
+{
+	// views copy the image after it is taken, so a view may still be drawing
+	// an earlier image.  styles are therefore only released once they have not
+	// been copied into the image since before the previous compaction
+	_previouslyCopiedStyles.resize(_styles.size());
+
+	_styleCount = 0;
+	for (int style = CharacterStyleTable::FixedStyleCount; style < _styles.size(); style++)
+	{
+		if (!_styles.testBit(style))
+			continue;
+
+		if (_copiedStyles.testBit(style) || _previouslyCopiedStyles.testBit(style))
+			_styleCount++;
+		else
+		{
+			_styles.clearBit(style);
+			CharacterStyleTable::instance()->deref(style);
+		}
+	}
+
+	_previouslyCopiedStyles = _copiedStyles;
+
+	// only the styles in the current image count as copied from now on
+	_copiedStyles.fill(false);
+	int imageStyleCount = 0;
+	quint16 lastStyle = CharacterStyleTable::DefaultStyle;
+	for (int i = 0; i < _windowBufferSize; i++)
+	{
+		const quint16 style = _windowBuffer[i].style;
+		if (style != lastStyle && style >= CharacterStyleTable::FixedStyleCount)
+		{
+			lastStyle = style;
+			if (!_copiedStyles.testBit(style))
+			{
+				_copiedStyles.setBit(style);
+				imageStyleCount++;
+			}
+		}
+	}
+
+	// the styles of the previous image are still held after the next
+	// compaction, so the limit grows with the number of styles held now
+	// rather than being a multiple of it
+	_stylesCompactionLimit = _styleCount + qMax(MinimumStylesCompactionLimit,imageStyleCount);
+}
+
+qint64 ScreenWindow::imageGeneration() const
+{
+	return _imageGeneration;
+}
+
+bool ScreenWindow::isLineChanged(int line , qint64 generation) const
+{
+	if (line < 0 || line >= _lineGenerations.count())
+		return true;
+
+	return _lineGenerations[line] > generation;
+}
+
+int ScreenWindow::cursorLine() const
+{
+	// the cursor can be one column beyond the right edge of the screen,
+	// in which case the character at the start of the next line is marked
+	const int line = _screen->getHistLines() + _screen->getCursorY() - currentLine();
+	return line + _screen->getCursorX() / windowColumns();
+}
+
 void ScreenWindow::fillUnusedArea()
 {
 	int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
@@ -107,6 +357,8 @@ int ScreenWindow::endWindowLine() const
 }
 QVector<LineProperty> ScreenWindow::getLineProperties()
 {
+    QMutexLocker locker(_screenLock);
+
     QVector<LineProperty> result = _screen->getLineProperties(currentLine(),endWindowLine());
 	
 	if (result.count() != windowLines())
@@ -117,21 +369,25 @@ QVector<LineProperty> ScreenWindow::getLineProperties()
 
 QString ScreenWindow::selectedText( bool preserveLineBreaks ) const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->selectedText( preserveLineBreaks );
 }
 
 void ScreenWindow::getSelectionStart( int& column , int& line )
 {
+    QMutexLocker locker(_screenLock);
     _screen->getSelectionStart(column,line);
     line -= currentLine();
 }
 void ScreenWindow::getSelectionEnd( int& column , int& line )
 {
+    QMutexLocker locker(_screenLock);
     _screen->getSelectionEnd(column,line);
     line -= currentLine();
 }
 void ScreenWindow::setSelectionStart( int column , int line , bool columnMode )
 {
+    QMutexLocker locker(_screenLock);
     _screen->setSelectionStart( column , qMin(line + currentLine(),endWindowLine())  , columnMode);
 	
 	_bufferNeedsUpdate = true;
@@ -140,6 +396,7 @@ void ScreenWindow::setSelectionStart( int column , int line , bool columnMode )
 
 void ScreenWindow::setSelectionEnd( int column , int line )
 {
+    QMutexLocker locker(_screenLock);
     _screen->setSelectionEnd( column , qMin(line + currentLine(),endWindowLine()) );
 
 	_bufferNeedsUpdate = true;
@@ -148,16 +405,23 @@ void ScreenWindow::setSelectionEnd( int column , int line )
 
 bool ScreenWindow::isSelected( int column , int line )
 {
+    QMutexLocker locker(_screenLock);
     return _screen->isSelected( column , qMin(line + currentLine(),endWindowLine()) );
 }
 
 void ScreenWindow::clearSelection()
 {
+    QMutexLocker locker(_screenLock);
     _screen->clearSelection();
 
     emit selectionChanged();
 }
 
+SelectionRange ScreenWindow::selectionRange() const
+{
+    return _imageSelection;
+}
+
 void ScreenWindow::setWindowLines(int lines)
 {
 	Q_ASSERT(lines > 0);
@@ -170,21 +434,31 @@ int ScreenWindow::windowLines() const
 
 int ScreenWindow::windowColumns() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getColumns();
 }
 
 int ScreenWindow::lineCount() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getHistLines() + _screen->getLines();
 }
 
 int ScreenWindow::columnCount() const
 {
+    QMutexLocker locker(_screenLock);
     return _screen->getColumns();
 }
 
 QPoint ScreenWindow::cursorPosition() const
 {
+    QMutexLocker locker(_screenLock);
+
+    // use the position at the time the image was last taken, so that the
+    // cursor is drawn in the right place relative to the image
+    if ( !_bufferNeedsUpdate )
+        return _cursorPosition;
+
     QPoint position;
     
     position.setX( _screen->getCursorX() );
@@ -217,6 +491,8 @@ bool ScreenWindow::atEndOfOutput() const
 
 void ScreenWindow::scrollTo( int line )
 {
+    QMutexLocker locker(_screenLock);
+
 	int maxCurrentLineNumber = lineCount() - windowLines();
 	line = qBound(0,line,maxCurrentLineNumber);
 
@@ -254,6 +530,7 @@ void ScreenWindow::resetScrollCount()
 
 QRect ScreenWindow::scrollRegion() const
 {
+    QMutexLocker locker(_screenLock);
 	bool equalToScreenSize = windowLines() == _screen->getLines();
 
 	if ( atEndOfOutput() && equalToScreenSize )
@@ -262,8 +539,24 @@ QRect ScreenWindow::scrollRegion() const
 		return QRect(0,0,windowColumns(),windowLines());
 }
 
+void ScreenWindow::setVisible(bool visible)
+{
+    if ( _visible != visible )
+    {
+        _visible = visible;
+        emit visibilityChanged(visible);
+    }
+}
+
+bool ScreenWindow::isVisible() const
+{
+    return _visible;
+}
+
 void ScreenWindow::notifyOutputChanged()
 {
+    QMutexLocker locker(_screenLock);
+
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if ( _trackOutput )
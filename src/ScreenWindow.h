@@ -21,6 +21,8 @@
 #define SCREENWINDOW_H
 
 // Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
@@ -33,6 +35,50 @@ namespace Konsole
 
 class Screen;
 
+/**
+ * Describes the selected part of a screen window.
+ *
+ * Normally the selection is a range of characters which runs from start() to end()
+ * in reading order.  In column mode, the selection is the rectangle with start()
+ * at its top-left corner and end() at its bottom-right corner.  Positions are
+ * given as (column,line) within the window and may lie outside of it.
+ */
+class SelectionRange
+{
+public:
+    /** Constructs an empty selection range. */
+    SelectionRange();
+    /** 
+     * Constructs a selection range from @p start to @p end, where
+     * @p start is not after @p end
+     */
+    SelectionRange(const QPoint& start , const QPoint& end , bool columnMode);
+
+    /** Returns true if nothing is selected. */
+    bool isEmpty() const { return _empty; }
+    /** Returns the first selected position. */
+    QPoint start() const { return _start; }
+    /** Returns the last selected position. */
+    QPoint end() const { return _end; }
+    /** Returns true if this is a column ( block ) selection. */
+    bool columnMode() const { return _columnMode; }
+
+    /**
+     * Retrieves the first and last selected columns in @p line of a window
+     * which is @p columns wide.  Returns false if no part of the line is selected.
+     */
+    bool selectedColumns(int line , int columns , int& left , int& right) const;
+
+    bool operator==(const SelectionRange& other) const;
+    bool operator!=(const SelectionRange& other) const { return !(*this == other); }
+
+private:
+    QPoint _start;
+    QPoint _end;
+    bool _columnMode;
+    bool _empty;
+};
+
 /**
  * Provides a window onto a section of a terminal screen.
  * This window can then be rendered by a terminal display widget ( TerminalDisplay ).
@@ -71,6 +117,17 @@ public:
     /** Returns the screen which this window looks onto */
     Screen* screen() const;
 
+    /**
+     * Sets the lock which must be held while the screen is accessed.
+     * If the screen is updated on a thread other than the one which the window
+     * is used from, the window takes this lock in each method which reads
+     * from or changes the screen.
+     *
+     * Emulation::createWindow() sets this to the emulation's lock.
+     * The default is no lock.
+     */
+    void setScreenLock(QMutex* lock);
+
     /** 
      * Returns the image of characters which are currently visible through this window
      * onto the screen.
@@ -80,6 +137,21 @@ public:
      */
     Character* getImage();
 
+    /**
+     * Returns the generation of the image returned by getImage().  The generation
+     * is incremented each time that getImage() copies changes from the screen
+     * into the image.
+     */
+    qint64 imageGeneration() const;
+    /**
+     * Returns true if line @p line of the image returned by getImage() has changed
+     * since the image's generation was @p generation.  See imageGeneration()
+     *
+     * Views of the window can use this to compare only the lines which have changed
+     * since they last updated.
+     */
+    bool isLineChanged(int line , qint64 generation) const;
+
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
@@ -139,6 +211,12 @@ public:
      * Clears the current selection
      */
     void clearSelection();
+    /**
+     * Returns the selection at the time that the image was last taken
+     * with getImage().  The selection is not part of the image, views draw it
+     * over the image themselves.
+     */
+    SelectionRange selectionRange() const;
 
 	/** Sets the number of lines in the window */
 	void setWindowLines(int lines);
@@ -157,7 +235,8 @@ public:
 
     /** 
      * Returns the position of the cursor 
-     * within the window.
+     * within the window.  Once getImage() has been called, this is the position
+     * of the cursor at the time the image was taken.
      */
     QPoint cursorPosition() const;
 
@@ -208,6 +287,17 @@ public:
      */
     QString selectedText( bool preserveLineBreaks ) const;
 
+    /**
+     * Sets whether the window is currently visible to the user.  This should be
+     * updated by the view displaying the window when it is shown or hidden.
+     *
+     * Updates to the window's output are deferred while it is not visible.
+     * Windows are visible by default.
+     */
+    void setVisible(bool visible);
+    /** Returns whether the window is currently visible.  See setVisible() */
+    bool isVisible() const;
+
 public slots:
     /** 
      * Notifies the window that the contents of the associated terminal screen have changed.
@@ -234,18 +324,55 @@ signals:
      */
     void selectionChanged();
 
+    /** Emitted when the window is shown or hidden.  See setVisible() */
+    void visibilityChanged(bool visible);
+
 private:
 	int endWindowLine() const;
 	void fillUnusedArea();
+	// returns the line of the window which contains the character that is
+	// marked with the cursor in the image
+	int cursorLine() const;
+	// adds references to the styles of 'count' characters which have been
+	// copied into the image, so that the styles are not removed from the
+	// CharacterStyleTable while the image or the views' copies of it use them
+	void useStyles(const Character* cells , int count);
+	// releases the references held on styles which are no longer used
+	// by the image
+	void compactStyles();
 
     Screen* _screen; // see setScreen() , screen()
 	Character* _windowBuffer;
 	int _windowBufferSize;
 	bool _bufferNeedsUpdate;
 
+	// the screen, position in the screen, number of lines in the screen and
+	// generation of the screen's contents when the image was last taken
+	Screen* _imageScreen;
+	int _imageLine;
+	int _imageLineCount;
+	qint64 _screenGeneration;
+	int _imageCursorLine;
+	SelectionRange _imageSelection; // see selectionRange()
+	qint64 _imageGeneration; // see imageGeneration()
+	QVector<qint64> _lineGenerations; // see isLineChanged()
+
+	// the styles which the window holds a reference to, and those which have
+	// been copied into the image since the last and the previous call
+	// to compactStyles().  the arrays are indexed by style
+	QBitArray _styles;
+	QBitArray _copiedStyles;
+	QBitArray _previouslyCopiedStyles;
+	int _styleCount;
+	// number of referenced styles above which compactStyles() is called
+	int _stylesCompactionLimit;
+
 	int  _windowLines;
+    QMutex* _screenLock; // see setScreenLock()
+    QPoint _cursorPosition; // cursor position when the image was last taken
     int  _currentLine; // see scrollTo() , currentLine()
     bool _trackOutput; // see setTrackOutput() , trackOutput() 
+    bool _visible;     // see setVisible() , isVisible()
     int  _scrollCount; // count of lines which the window has been scrolled by since
                        // the last call to resetScrollCount()
 };
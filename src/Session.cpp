@@ -40,6 +40,7 @@
 
 // KDE
 #include <KDebug>
+#include <KIO/Job>
 #include <KLocale>
 #include <KMessageBox>
 #include <KNotification>
@@ -52,9 +53,14 @@
 #include <config-konsole.h>
 #include <sessionadaptor.h>
 
+#include "EmulationThreadPool.h"
+#include "LatencyProbe.h"
+#include "PasteJob.h"
 #include "Pty.h"
+#include "PtyCapture.h"
 #include "TerminalDisplay.h"
 #include "ShellCommand.h"
+#include "TraceRecorder.h"
 #include "Vt102Emulation.h"
 #include "ZModemDialog.h"
 
@@ -62,9 +68,15 @@ using namespace Konsole;
 
 int Session::lastSessionId = 0;
 
+// pastes longer than this ( in characters ) show their progress
+static const int LongPasteLength = 256 * 1024;
+
 Session::Session() :
     _shellProcess(0)
    , _emulation(0)
+   , _replay(0)
+   , _pasteJob(0)
+   , _latencyProbe(0)
    , _monitorActivity(false)
    , _monitorSilence(false)
    , _notifiedActivity(false)
@@ -126,6 +138,9 @@ Session::Session() :
     _monitorTimer = new QTimer(this);
     _monitorTimer->setSingleShot(true);
     connect(_monitorTimer, SIGNAL(timeout()), this, SLOT(monitorTimerDone()));
+
+    if ( !qgetenv("KONSOLE_LATENCY_PROBE").isEmpty() )
+        setLatencyProbeEnabled(true);
 }
 
 WId Session::windowId() const
@@ -204,10 +219,15 @@ void Session::addView(TerminalDisplay* widget)
         // connect emulation - view signals and slots
         connect( widget , SIGNAL(keyPressedSignal(QKeyEvent*)) , _emulation ,
                SLOT(sendKeyEvent(QKeyEvent*)) );
+
+        if ( _latencyProbe )
+            _latencyProbe->addView(widget);
         connect( widget , SIGNAL(mouseSignal(int,int,int,int)) , _emulation ,
                SLOT(sendMouseEvent(int,int,int,int)) );
         connect( widget , SIGNAL(sendStringToEmu(const char*)) , _emulation ,
                SLOT(sendString(const char*)) );
+        connect( widget , SIGNAL(pasteRequest(const QString&)) , this ,
+               SLOT(pasteText(const QString&)) );
 
         // allow emulation to notify view when the foreground process
         // indicates whether or not it is interested in mouse signals
@@ -299,12 +319,17 @@ void Session::terminalWarning(const QString& message)
     static const char* redPenOn = "\033[1m\033[31m";
 	static const char* redPenOff = "\033[0m";
 
-    _emulation->receiveData(redPenOn,strlen(redPenOn));
-    _emulation->receiveData("\n\r\n\r",4);
-    _emulation->receiveData(warningText.constData(),strlen(warningText.constData()));
-	_emulation->receiveData(messageText.constData(),strlen(messageText.constData()));
-	_emulation->receiveData("\n\r\n\r",4);
-	_emulation->receiveData(redPenOff,strlen(redPenOff));
+    QByteArray text;
+    text += redPenOn;
+    text += "\n\r\n\r";
+    text += warningText;
+    text += messageText;
+    text += "\n\r\n\r";
+    text += redPenOff;
+
+    // queue the warning behind any output from the terminal which has not
+    // been processed yet
+    EmulationThreadPool::instance()->receiveData(_emulation,text.constData(),text.length());
 }
 void Session::run()
 {
@@ -379,6 +404,52 @@ void Session::run()
   emit started();
 }
 
+bool Session::setCaptureFile(const QString& fileName)
+{
+    return _shellProcess->setCaptureFile(fileName);
+}
+
+void Session::replay(const QString& fileName , bool realTime)
+{
+    if ( !_replay )
+    {
+        _replay = new PtyReplay(this);
+
+        connect( _replay , SIGNAL(receivedData(const char*,int)) , this ,
+                SLOT(onReceiveBlock(const char*,int)) );
+        connect( _replay , SIGNAL(windowSizeChanged(int,int)) , this ,
+                SLOT(onReplayWindowSizeChange(int,int)) );
+        connect( _replay , SIGNAL(finished()) , this , SLOT(onReplayFinished()) );
+    }
+
+    if ( !_replay->start(fileName,realTime) )
+    {
+        terminalWarning(i18n("Could not open the capture file '%1'.",fileName));
+        return;
+    }
+
+    emit started();
+}
+
+void Session::onReplayWindowSizeChange(int lines , int columns)
+{
+    if ( lines > 0 && columns > 0 )
+    {
+        _emulation->setImageSize( lines , columns );
+        _shellProcess->setWindowSize( lines , columns );
+    }
+}
+
+void Session::onReplayFinished()
+{
+    _userTitle = i18n("Replay Finished");
+    emit titleChanged();
+
+    // the capture may have been recorded with a different terminal size
+    // to that of the views
+    updateTerminalSize();
+}
+
 void Session::setUserTitle( int what, const QString &caption )
 {
     //set to true if anything is actually changed (eg. old _nameTitle != new _nameTitle )
@@ -535,6 +606,11 @@ void Session::onEmulationSizeChange(int lines , int columns)
 
 void Session::updateTerminalSize()
 {
+    // while a capture is being replayed, the terminal size follows
+    // the sizes recorded in the capture instead of the views
+    if ( _replay && _replay->isActive() )
+        return;
+
     QListIterator<TerminalDisplay*> viewIter(_views);
 
     int minLines = -1;
@@ -620,6 +696,20 @@ void Session::sendText(const QString &text) const
 
 Session::~Session()
 {
+  if ( _latencyProbe && _latencyProbe->sampleCount() > 0 )
+  {
+      const QVariantMap statistics = _latencyProbe->statistics();
+      kDebug() << "Key press latency of session" << _sessionId << "in microseconds:"
+               << "min" << statistics["totalMin"].toLongLong()
+               << "median" << statistics["totalMedian"].toLongLong()
+               << "99th percentile" << statistics["totalP99"].toLongLong()
+               << "(" << statistics["samples"].toInt() << "samples )";
+  }
+
+  if ( _pasteJob )
+      _pasteJob->kill();
+
+  EmulationThreadPool::instance()->removeEmulation(_emulation);
   delete _emulation;
   delete _shellProcess;
   delete _zmodemProc;
@@ -925,9 +1015,107 @@ void Session::zmodemFinished()
   }
 }
 
+QVariantMap Session::performanceCounters() const
+{
+    qlonglong framesPainted = 0;
+    qlonglong updateTime = 0;
+    qlonglong paintTime = 0;
+
+    QListIterator<TerminalDisplay*> viewIter(_views);
+    while ( viewIter.hasNext() )
+    {
+        TerminalDisplay* view = viewIter.next();
+        framesPainted += view->paintCount();
+        updateTime += view->updateTime();
+        paintTime += view->paintTime();
+    }
+
+    QVariantMap counters;
+    counters["bytesRead"] = (qlonglong)_shellProcess->bytesRead();
+    counters["charactersParsed"] = (qlonglong)_emulation->parsedCharacters();
+    counters["escapeSequences"] = (qlonglong)_emulation->escapeSequences();
+    counters["historyLines"] = (qlonglong)_emulation->historyLinesAdded();
+    counters["framesPainted"] = framesPainted;
+    counters["receiveTime"] = (qlonglong)_emulation->receiveTime();
+    counters["updateTime"] = updateTime;
+    counters["paintTime"] = paintTime;
+
+    return counters;
+}
+
+void Session::setLatencyProbeEnabled(bool enable)
+{
+    if ( enable == (_latencyProbe != 0) )
+        return;
+
+    if ( enable )
+    {
+        _latencyProbe = new LatencyProbe(_emulation,this);
+
+        QListIterator<TerminalDisplay*> viewIter(_views);
+        while ( viewIter.hasNext() )
+            _latencyProbe->addView(viewIter.next());
+    }
+    else
+    {
+        delete _latencyProbe;
+        _latencyProbe = 0;
+    }
+}
+
+QVariantMap Session::latencyStatistics() const
+{
+    if ( _latencyProbe )
+        return _latencyProbe->statistics();
+
+    QVariantMap statistics;
+    statistics["samples"] = 0;
+    return statistics;
+}
+
+void Session::startTrace(const QString& fileName)
+{
+    TraceRecorder::instance()->start(fileName);
+}
+
+bool Session::stopTrace()
+{
+    return TraceRecorder::instance()->stop();
+}
+
+void Session::pasteText(const QString& text)
+{
+    // if the user pastes again before the previous paste has been sent,
+    // send the new text after it
+    if ( _pasteJob )
+    {
+        _pasteJob->appendText(text);
+        return;
+    }
+
+    _pasteJob = new PasteJob(_emulation,_shellProcess,text,this);
+    connect( _pasteJob , SIGNAL(finished(KJob*)) , this , SLOT(pasteFinished()) );
+
+    // show the progress of pastes which take a while to send and allow them
+    // to be cancelled
+    if ( text.length() > LongPasteLength )
+        KIO::getJobTracker()->registerJob(_pasteJob);
+
+    _pasteJob->start();
+}
+
+void Session::pasteFinished()
+{
+    _pasteJob = 0;
+}
+
 void Session::onReceiveBlock( const char* buf, int len )
 {
-    _emulation->receiveData( buf, len );
+    if ( _latencyProbe )
+        _latencyProbe->outputReceived(len);
+
+    EmulationThreadPool::instance()->receiveData( _emulation, buf, len );
+
     emit receivedData( QString::fromLatin1( buf, len ) );
 }
 
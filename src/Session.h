@@ -26,6 +26,7 @@
 // Qt
 #include <QtCore/QStringList>
 #include <QtCore/QByteRef>
+#include <QtCore/QVariant>
 
 // KDE
 #include <KApplication>
@@ -40,7 +41,10 @@ namespace Konsole
 {
 
 class Emulation;
+class LatencyProbe;
+class PasteJob;
 class Pty;
+class PtyReplay;
 class TerminalDisplay;
 class ZModemDialog;
 
@@ -344,6 +348,29 @@ public:
    */
   void refresh();
 
+  /**
+   * Starts recording the output from the terminal process and changes in
+   * the terminal size to the capture file @p fileName.  The capture can be
+   * replayed later using replay().
+   *
+   * If @p fileName is empty, any recording in progress is stopped.
+   * Returns false if the capture file could not be opened.
+   */
+  bool setCaptureFile(const QString& fileName);
+
+  /**
+   * Replays a capture file recorded with setCaptureFile() in this session.
+   * This is used instead of run() and does not start a terminal process.
+   *
+   * The terminal is resized to the sizes recorded in the capture while
+   * the replay is in progress.
+   *
+   * @param fileName The capture file to replay.
+   * @param realTime If true, the capture is replayed at the speed at which
+   * it was recorded, otherwise it is replayed as fast as possible.
+   */
+  void replay(const QString& fileName , bool realTime);
+
   void startZModem(const QString &rz, const QString &dir, const QStringList &list);
   void cancelZModem();
   bool isZModemBusy() { return _zmodemBusy; }
@@ -389,6 +416,67 @@ public slots:
    */
   void setUserTitle( int what , const QString &caption );
 
+  /**
+   * Returns counters which describe the work done by the session since
+   * it was created.  This is exported over D-Bus so that the load caused by
+   * individual sessions can be monitored.
+   *
+   * The counters are:
+   *
+   * <ul>
+   * <li>bytesRead - bytes of output read from the terminal</li>
+   * <li>charactersParsed - characters decoded from the output and processed
+   *     by the emulation</li>
+   * <li>escapeSequences - escape sequences processed by the emulation</li>
+   * <li>historyLines - lines moved from the screen into the history</li>
+   * <li>framesPainted - number of times the session's views were painted</li>
+   * <li>receiveTime - time spent processing output, in microseconds</li>
+   * <li>updateTime - time spent by the views fetching changes to the screen,
+   *     in microseconds</li>
+   * <li>paintTime - time spent painting the views, in microseconds</li>
+   * </ul>
+   *
+   * The view counters only include views which are currently showing the session.
+   */
+  QVariantMap performanceCounters() const;
+
+  /**
+   * Enables or disables measuring the time between the user pressing a key in
+   * one of the session's views and the terminal program's response appearing
+   * on screen.  Measuring can also be enabled for all sessions by setting
+   * the KONSOLE_LATENCY_PROBE environment variable.
+   *
+   * Disabling the measurement discards the existing results.
+   *
+   * See LatencyProbe for details of what is measured.
+   */
+  void setLatencyProbeEnabled(bool enable);
+
+  /**
+   * Returns the minimum, median and 99th percentile latency of key presses
+   * in the session, in microseconds, along with the time spent in
+   * each stage of handling them.  See LatencyProbe::statistics()
+   *
+   * The result only contains the number of measurements ( which is 0 )
+   * if measuring has not been enabled with setLatencyProbeEnabled()
+   */
+  QVariantMap latencyStatistics() const;
+
+  /**
+   * Starts recording a trace of the work done to read, process and display
+   * terminal output.  The trace covers all sessions in the process, not just
+   * this one.  It is written to @p fileName when stopTrace() is called.
+   *
+   * See TraceRecorder
+   */
+  void startTrace(const QString& fileName);
+
+  /**
+   * Stops recording the trace started with startTrace() and writes it out.
+   * Returns false if the trace could not be written.
+   */
+  bool stopTrace();
+
 signals:
 
   /** Emitted when the terminal process starts. */
@@ -474,6 +562,13 @@ private slots:
   void onReceiveBlock( const char* buffer, int len );
   void monitorTimerDone();
 
+  void onReplayWindowSizeChange(int lines , int columns);
+  void onReplayFinished();
+
+  // sends a large block of pasted text to the terminal, see TerminalDisplay::pasteRequest()
+  void pasteText(const QString& text);
+  void pasteFinished();
+
   void onViewSizeChange(int height, int width);
   void onEmulationSizeChange(int lines , int columns);
 
@@ -504,6 +599,9 @@ private:
 
   Pty*          _shellProcess;
   Emulation*    _emulation;
+  PtyReplay*    _replay;
+  PasteJob*     _pasteJob;
+  LatencyProbe* _latencyProbe;
 
   QList<TerminalDisplay*> _views;
 
@@ -44,6 +44,7 @@
 // Konsole
 #include "EditProfileDialog.h"
 #include "Emulation.h"
+#include "EmulationThreadPool.h"
 #include "Filter.h"
 #include "History.h"
 #include "IncrementalSearchBar.h"
@@ -53,6 +54,7 @@
 #include "ProfileList.h"
 #include "TerminalDisplay.h"
 #include "SessionManager.h"
+#include "TraceRecorder.h"
 
 // for SaveHistoryTask
 #include <KFileDialog>
@@ -345,6 +347,10 @@ bool SessionController::eventFilter(QObject* watched , QEvent* event)
             // used by the view manager to update the title of the MainWindow widget containing the view
             emit focused(this);
 
+            // process output from the session which the user is interacting with
+            // ahead of output from other sessions
+            EmulationThreadPool::instance()->setFocusedEmulation(_session->emulation());
+
             // when the view is focused, set bell events from the associated session to be delivered
             // by the focused view
 
@@ -903,7 +909,10 @@ void SessionController::scrollBackOptionsChanged( int mode , int lines )
         	_session->setHistoryType( HistoryTypeNone() );
 			break;
      	case HistorySizeDialog::FixedSizeHistory:
-        	_session->setHistoryType( HistoryTypeBuffer(lines) );
+			if ( lines > HistoryTypeCompressed::CompressionThreshold )
+				_session->setHistoryType( HistoryTypeCompressed(lines) );
+			else
+        		_session->setHistoryType( HistoryTypeBuffer(lines) );
 			break;
      	case HistorySizeDialog::UnlimitedHistory:
          	_session->setHistoryType( HistoryTypeFile() );
@@ -1243,6 +1252,8 @@ void SearchHistoryTask::addScreenWindow( Session* session , ScreenWindow* search
 }
 void SearchHistoryTask::execute()
 {
+    TraceSpan span("SearchHistoryTask::execute");
+
     QMapIterator< SessionPtr , ScreenWindowPtr > iter(_windows);
 
     while ( iter.hasNext() )
@@ -418,7 +418,10 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr info , bo
             case Profile::FixedSizeHistory:
                 {
                     int lines = info->property<int>(Profile::HistorySize);
-                    session->setHistoryType( HistoryTypeBuffer(lines) );
+                    if ( lines > HistoryTypeCompressed::CompressionThreshold )
+                        session->setHistoryType( HistoryTypeCompressed(lines) );
+                    else
+                        session->setHistoryType( HistoryTypeBuffer(lines) );
                 }
                 break;
             case Profile::UnlimitedHistory:
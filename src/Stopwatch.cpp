@@ -0,0 +1,53 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Stopwatch.h"
+
+// System
+#include <time.h>
+
+using namespace Konsole;
+
+Stopwatch::Stopwatch()
+{
+    start();
+}
+
+void Stopwatch::start()
+{
+    _startTime = currentTime();
+}
+
+qint64 Stopwatch::elapsed() const
+{
+    return currentTime() - _startTime;
+}
+
+qint64 Stopwatch::currentTime()
+{
+    // use the monotonic clock so that measurements are not affected
+    // by changes to the system time
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC,&time);
+
+    return (qint64)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
@@ -0,0 +1,63 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+// Qt
+#include <QtCore/QtGlobal>
+
+namespace Konsole
+{
+
+/**
+ * Measures short intervals with microsecond resolution.
+ *
+ * Unlike QTime, which only has millisecond resolution, the stopwatch
+ * is precise enough to time the processing of individual blocks of
+ * output and does not wrap around at midnight.
+ */
+class Stopwatch
+{
+public:
+    /** Constructs a stopwatch and starts it. */
+    Stopwatch();
+
+    /** Restarts the stopwatch. */
+    void start();
+
+    /** Returns the time in microseconds since the stopwatch was started. */
+    qint64 elapsed() const;
+
+    /**
+     * Returns the current time in microseconds from a monotonic clock.
+     * This is only useful for comparing with other values returned by
+     * currentTime()
+     */
+    static qint64 currentTime();
+
+private:
+    qint64 _startTime;
+};
+
+}
+
+#endif // STOPWATCH_H
@@ -30,6 +30,16 @@
 
 using namespace Konsole;
 
+// appends the sequence of characters with the specified key in the
+// ExtendedCharTable to 'text'
+static void appendExtendedChar(QString& text , quint16 key)
+{
+    ushort chars[ExtendedCharTable::MaximumSequenceLength];
+    ushort length = ExtendedCharTable::instance.lookupExtendedChar(key,chars);
+    for ( int i = 0 ; i < length ; i++ )
+        text.append( QChar(chars[i]) );
+}
+
 PlainTextDecoder::PlainTextDecoder()
  : _output(0)
  , _includeTrailingWhitespace(true)
@@ -99,7 +109,10 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
 
 	for (int i=0;i<outputCount;i++)
 	{
-		plainText.append( QChar(characters[i].character) );
+		if ( characters[i].rendition() & RE_EXTENDED_CHAR )
+			appendExtendedChar(plainText,characters[i].charSequence);
+		else
+			plainText.append( QChar(characters[i].character) );
 	}
 
 	*_output << plainText;
@@ -155,16 +168,16 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 		QChar ch(characters[i].character);
 
 		//check if appearance of character is different from previous char
-		if ( characters[i].rendition != _lastRendition  ||
-		     characters[i].foregroundColor != _lastForeColor  ||
-			 characters[i].backgroundColor != _lastBackColor )
+		if ( characters[i].rendition() != _lastRendition  ||
+		     characters[i].foregroundColor() != _lastForeColor  ||
+			 characters[i].backgroundColor() != _lastBackColor )
 		{
 			if ( _innerSpanOpen )
 					closeSpan(text);
 
-			_lastRendition = characters[i].rendition;
-			_lastForeColor = characters[i].foregroundColor;
-			_lastBackColor = characters[i].backgroundColor;
+			_lastRendition = characters[i].rendition();
+			_lastForeColor = characters[i].foregroundColor();
+			_lastBackColor = characters[i].backgroundColor();
 			
 			//build up style string
 			QString style;
@@ -193,6 +206,14 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
 			_innerSpanOpen = true;
 		}
 
+		//output sequences of characters as they are
+		if ( _lastRendition & RE_EXTENDED_CHAR )
+		{
+			appendExtendedChar(text,characters[i].charSequence);
+			spaceCount = 0;
+			continue;
+		}
+
 		//handle whitespace
 		if (ch.isSpace())
 			spaceCount++;
@@ -56,9 +56,12 @@
 // Konsole
 #include <config-apps.h>
 #include "Filter.h"
+#include "FrameClock.h"
 #include "konsole_wcwidth.h"
 #include "ScreenWindow.h"
+#include "Stopwatch.h"
 #include "TerminalCharacterDecoder.h"
+#include "TraceRecorder.h"
 
 using namespace Konsole;
 
@@ -105,6 +108,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
     }
 
     _screenWindow = window;
+    _imageGeneration = 0;
 
     if ( window )
     {
@@ -112,6 +116,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
         connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateLineProperties()) );
         connect( _screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateImage()) );
 		window->setWindowLines(_lines);
+        window->setVisible(isVisible());
     }
 }
 
@@ -170,16 +175,6 @@ static inline bool isLineCharString(const QString& string)
 }
 						
 
-// assert for i in [0..31] : vt100extended(vt100_graphics[i]) == i.
-
-unsigned short Konsole::vt100_graphics[32] =
-{ // 0/8     1/9    2/10    3/11    4/12    5/13    6/14    7/15
-  0x0020, 0x25C6, 0x2592, 0x2409, 0x240c, 0x240d, 0x240a, 0x00b0,
-  0x00b1, 0x2424, 0x240b, 0x2518, 0x2510, 0x250c, 0x2514, 0x253c,
-  0xF800, 0xF801, 0x2500, 0xF803, 0xF804, 0x251c, 0x2524, 0x2534,
-  0x252c, 0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00b7
-};
-
 void TerminalDisplay::fontChange(const QFont&)
 {
   QFontMetrics fm(font());
@@ -267,6 +262,7 @@ TerminalDisplay::TerminalDisplay(QWidget *parent)
 ,_contentHeight(1)
 ,_contentWidth(1)
 ,_image(0)
+,_imageGeneration(0)
 ,_randomSeed(0)
 ,_resizing(false)
 ,_terminalSizeHint(false)
@@ -296,6 +292,9 @@ TerminalDisplay::TerminalDisplay(QWidget *parent)
 ,_blendColor(qRgba(0,0,0,0xff))
 ,_filterChain(new TerminalImageFilterChain())
 ,_cursorShape(BlockCursor)
+,_paintCount(0)
+,_paintTime(0)
+,_updateTime(0)
 {
   // terminal applications are not designed with Right-To-Left in mind,
   // so the layout is forced to Left-To-Right
@@ -489,7 +488,7 @@ void TerminalDisplay::drawLineCharString(	QPainter& painter, int x, int y, const
 {
 		const QPen& currentPen = painter.pen();
 		
-		if ( attributes->rendition & RE_BOLD )
+		if ( attributes->rendition() & RE_BOLD )
 		{
 			QPen boldPen(currentPen);
 			boldPen.setWidth(3);
@@ -640,12 +639,12 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
                                      bool invertCharacterColor)
 {
     // don't draw text which is currently blinking
-    if ( _blinking && (style->rendition & RE_BLINK) )
+    if ( _blinking && (style->rendition() & RE_BLINK) )
             return;
    
     // setup bold and underline
-    bool useBold = style->rendition & RE_BOLD || style->isBold(_colorTable) || font().bold();
-    bool useUnderline = style->rendition & RE_UNDERLINE || font().underline();
+    bool useBold = style->rendition() & RE_BOLD || style->isBold(_colorTable) || font().bold();
+    bool useUnderline = style->rendition() & RE_UNDERLINE || font().underline();
 
     QFont font = painter.font();
     if (    font.bold() != useBold 
@@ -657,7 +656,7 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     }
 
     // setup pen
-    const CharacterColor& textColor = ( invertCharacterColor ? style->backgroundColor : style->foregroundColor );
+    const CharacterColor& textColor = ( invertCharacterColor ? style->backgroundColor() : style->foregroundColor() );
     const QColor color = textColor.color(_colorTable);
     QPen pen = painter.pen();
     if ( pen.color() != color )
@@ -691,8 +690,8 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     painter.save();
 
     // setup painter 
-    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
-    const QColor backgroundColor = style->backgroundColor.color(_colorTable);
+    const QColor foregroundColor = style->foregroundColor().color(_colorTable);
+    const QColor backgroundColor = style->backgroundColor().color(_colorTable);
     
     // draw background if different from the display's background color
     if ( backgroundColor != palette().background().color() )
@@ -702,7 +701,7 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
     // draw cursor shape if the current character is the cursor
     // this may alter the foreground and background colors
     bool invertCharacterColor = false;
-    if ( style->rendition & RE_CURSOR )
+    if ( style->rendition() & RE_CURSOR )
         drawCursor(painter,rect,foregroundColor,backgroundColor,invertCharacterColor);
 
     // draw text
@@ -825,10 +824,64 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
 	Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
+    //the lines of the internal image no longer match the lines of the
+    //screen window's image that they were copied from
+    _imageGeneration = 0;
+
     //scroll the display vertically to match internal _image
     scroll( 0 , _fontHeight * (-lines) , scrollRect );
 }
 
+QRegion TerminalDisplay::selectionChangeRegion(const SelectionRange& oldSelection ,
+                                               const SelectionRange& newSelection ,
+                                               int scrolledLines) const
+{
+	QRegion region;
+
+	if ( oldSelection.isEmpty() && newSelection.isEmpty() )
+		return region;
+
+	QPoint tL  = contentsRect().topLeft();
+	int    tLx = tL.x();
+	int    tLy = tL.y();
+
+	for ( int y = 0 ; y < _usedLines ; y++ )
+	{
+		bool changed = false;
+
+		// after scrolling, the lines of the display near the old selection
+		// may show the selection of other lines, so they are always repainted
+		if ( scrolledLines != 0 && !oldSelection.isEmpty() &&
+			 y >= oldSelection.start().y() - qAbs(scrolledLines) &&
+			 y <= oldSelection.end().y() + qAbs(scrolledLines) )
+		{
+			changed = true;
+		}
+		else
+		{
+			int oldLeft = 0;
+			int oldRight = 0;
+			int newLeft = 0;
+			int newRight = 0;
+			bool oldSelected = oldSelection.selectedColumns(y,_usedColumns,oldLeft,oldRight);
+			bool newSelected = newSelection.selectedColumns(y,_usedColumns,newLeft,newRight);
+
+			changed = ( oldSelected != newSelected ) ||
+					  ( oldSelected && (oldLeft != newLeft || oldRight != newRight) );
+		}
+
+		if ( changed )
+		{
+			region |= QRect( _leftMargin+tLx ,
+							 _topMargin+tLy+_fontHeight*y ,
+							 _fontWidth * _usedColumns ,
+							 _fontHeight );
+		}
+	}
+
+	return region;
+}
+
 QRegion TerminalDisplay::hotSpotRegion() const 
 {
 	QRegion region;
@@ -873,10 +926,15 @@ void TerminalDisplay::updateImage()
   if ( !_screenWindow )
       return;
 
+  TraceSpan span("TerminalDisplay::updateImage");
+
+  Stopwatch updateTime;
+
   // optimization - scroll the existing image where possible and 
   // avoid expensive text drawing for parts of the image that 
   // can simply be moved up or down
-  scrollImage( _screenWindow->scrollCount() ,
+  const int scrolledLines = _screenWindow->scrollCount();
+  scrollImage( scrolledLines ,
                _screenWindow->scrollRegion() );
   _screenWindow->resetScrollCount();
 
@@ -897,11 +955,15 @@ void TerminalDisplay::updateImage()
   QPoint tL  = contentsRect().topLeft();
   int    tLx = tL.x();
   int    tLy = tL.y();
-  _hasBlinker = false;
 
-  CharacterColor cf;       // undefined
-  CharacterColor _clipboard;       // undefined
-  int cr  = -1;   // undefined
+  // only the lines which have changed in the screen window's image since it was
+  // last copied into _image are compared.  blinking characters are only looked for
+  // in those lines, so _hasBlinker is only reset when every line is compared
+  const qint64 lastGeneration = _imageGeneration;
+  if ( lastGeneration == 0 )
+      _hasBlinker = false;
+
+  quint16 currentStyle = CharacterStyleTable::DefaultStyle;
 
   const int linesToUpdate = qMin(this->_lines, qMax(0,lines  ));
   const int columnsToUpdate = qMin(this->_columns,qMax(0,columns));
@@ -917,6 +979,12 @@ void TerminalDisplay::updateImage()
 
   for (y = 0; y < linesToUpdate; y++)
   {
+    // both the top and bottom halves of double height lines are always
+    // compared, see below
+    if ( !_screenWindow->isLineChanged(y,lastGeneration) &&
+         !(_lineProperties.count() > y && (_lineProperties[y] & LINE_DOUBLEHEIGHT)) )
+        continue;
+
     const Character*       currentLine = &_image[y*this->_columns];
     const Character* const newLine = &newimg[y*columns];
 
@@ -938,7 +1006,7 @@ void TerminalDisplay::updateImage()
     if (!_resizing) // not while _resizing, we're expecting a paintEvent
     for (x = 0; x < columnsToUpdate; x++)
     {
-      _hasBlinker |= (newLine[x].rendition & RE_BLINK);
+      _hasBlinker |= (newLine[x].rendition() & RE_BLINK);
     
       // Start drawing if this character or the next one differs.
       // We also take the next one into account to handle the situation
@@ -952,9 +1020,7 @@ void TerminalDisplay::updateImage()
         disstrU[p++] = c; //fontMap(c);
         bool lineDraw = isLineChar(c);
         bool doubleWidth = (x+1 == columnsToUpdate) ? false : (newLine[x+1].character == 0);
-        cr = newLine[x].rendition;
-        _clipboard = newLine[x].backgroundColor;
-        if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
+        currentStyle = newLine[x].style;
         int lln = columnsToUpdate - x;
         for (len = 1; len < lln; len++)
         {
@@ -965,9 +1031,7 @@ void TerminalDisplay::updateImage()
 
 			bool nextIsDoubleWidth = (x+len+1 == columnsToUpdate) ? false : (newLine[x+len+1].character == 0);
 
-            if (  ch.foregroundColor != cf || 
-                  ch.backgroundColor != _clipboard || 
-                  ch.rendition != cr ||
+            if (  ch.style != currentStyle ||
                   !dirtyMask[x+len] || 
                   isLineChar(c) != lineDraw || 
                   nextIsDoubleWidth != doubleWidth )
@@ -1040,6 +1104,17 @@ void TerminalDisplay::updateImage()
   }
   _usedColumns = columnsToUpdate;
 
+  _imageGeneration = _screenWindow->imageGeneration();
+
+  // the selection is not part of the image, so repaint the lines in which it
+  // has changed
+  const SelectionRange selection = _screenWindow->selectionRange();
+  if ( selection != _selection || scrolledLines != 0 )
+  {
+      dirtyRegion |= selectionChangeRegion(_selection,selection,scrolledLines);
+      _selection = selection;
+  }
+
   dirtyRegion |= _inputMethodData.previousPreeditRect;
 
   // update the parts of the display which have changed
@@ -1050,6 +1125,7 @@ void TerminalDisplay::updateImage()
   delete[] dirtyMask;
   delete[] disstrU;
 
+  _updateTime += updateTime.elapsed();
 }
 
 void TerminalDisplay::showResizeNotification()
@@ -1127,6 +1203,8 @@ void TerminalDisplay::focusInEvent(QFocusEvent*)
 
 void TerminalDisplay::paintEvent( QPaintEvent* pe )
 {
+  Stopwatch paintTime;
+
   QPainter paint(this);
 
   foreach (QRect rect, (pe->region() & contentsRect()).rects())
@@ -1137,6 +1215,26 @@ void TerminalDisplay::paintEvent( QPaintEvent* pe )
   }
   drawInputMethodPreeditString(paint,preeditRect());
   paintFilters(paint);
+
+  const qint64 elapsed = paintTime.elapsed();
+  _paintCount++;
+  _paintTime += elapsed;
+
+  // the frame rate is reduced if painting is slow
+  FrameClock::instance()->addPaintTime(elapsed / 1000);
+}
+
+quint64 TerminalDisplay::paintCount() const
+{
+    return _paintCount;
+}
+qint64 TerminalDisplay::paintTime() const
+{
+    return _paintTime;
+}
+qint64 TerminalDisplay::updateTime() const
+{
+    return _updateTime;
 }
 
 QPoint TerminalDisplay::cursorPosition() const
@@ -1194,7 +1292,7 @@ void TerminalDisplay::paintFilters(QPainter& painter)
     getCharacterPosition( cursorPos , cursorLine , cursorColumn );
     Character cursorCharacter = _image[loc(cursorColumn,cursorLine)];
 
-    painter.setPen( QPen(cursorCharacter.foregroundColor.color(colorTable())) );
+    painter.setPen( QPen(cursorCharacter.foregroundColor().color(colorTable())) );
 
     // iterate over hotspots identified by the display's currently active filters 
     // and draw appropriate visuals to indicate the presence of the hotspot
@@ -1265,6 +1363,8 @@ void TerminalDisplay::paintFilters(QPainter& painter)
 }
 void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
 {
+  TraceSpan span("TerminalDisplay::drawContents");
+
   QPoint tL  = contentsRect().topLeft();
   int    tLx = tL.x();
   int    tLy = tL.y();
@@ -1274,7 +1374,7 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
   int rlx = qMin(_usedColumns-1, qMax(0,(rect.right()  - tLx - _leftMargin ) / _fontWidth));
   int rly = qMin(_usedLines-1,  qMax(0,(rect.bottom() - tLy - _topMargin  ) / _fontHeight));
 
-  const int bufferSize = _usedColumns;
+  const int bufferSize = qMax(_usedColumns,ExtendedCharTable::MaximumSequenceLength);
   QChar *disstrU = new QChar[bufferSize];
   for (int y = luy; y <= rly; y++)
   {
@@ -1282,23 +1382,33 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
     int x = lux;
     if(!c && x)
       x--; // Search for start of multi-column character
+
+    // the selection is drawn over the image by reversing the colors
+    // of the selected characters
+    int selectionLeft = 0;
+    int selectionRight = -1;
+    if ( !_selection.selectedColumns(y,_usedColumns,selectionLeft,selectionRight) )
+        selectionRight = -1;
+
     for (; x <= rlx; x++)
     {
       int len = 1;
       int p = 0;
 
       // is this a single character or a sequence of characters ?
-      if ( _image[loc(x,y)].rendition & RE_EXTENDED_CHAR )
+      const bool extended = _image[loc(x,y)].rendition() & RE_EXTENDED_CHAR;
+      if ( extended )
       {
         // sequence of characters
-        ushort extendedCharLength = 0;
-        ushort* chars = ExtendedCharTable::instance
-                            .lookupExtendedChar(_image[loc(x,y)].charSequence,extendedCharLength);
+        ushort chars[ExtendedCharTable::MaximumSequenceLength];
+        ushort extendedCharLength = ExtendedCharTable::instance
+                            .lookupExtendedChar(_image[loc(x,y)].charSequence,chars);
         for ( int index = 0 ; index < extendedCharLength ; index++ ) 
         {
             Q_ASSERT( p < bufferSize );
             disstrU[p++] = chars[index];
         }
+        c = extendedCharLength > 0 ? chars[0] : 0;
       }
       else
       {
@@ -1313,14 +1423,15 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
 
       bool lineDraw = isLineChar(c);
       bool doubleWidth = (_image[ qMin(loc(x,y)+1,_imageSize) ].character == 0);
-      CharacterColor currentForeground = _image[loc(x,y)].foregroundColor;
-      CharacterColor currentBackground = _image[loc(x,y)].backgroundColor;
-      quint8 currentRendition = _image[loc(x,y)].rendition;
+      const quint16 currentStyle = _image[loc(x,y)].style;
+      const bool selected = x >= selectionLeft && x <= selectionRight;
 	  
-      while (x+len <= rlx &&
-             _image[loc(x+len,y)].foregroundColor == currentForeground &&
-             _image[loc(x+len,y)].backgroundColor == currentBackground &&
-             _image[loc(x+len,y)].rendition == currentRendition &&
+      // characters with the same style as a sequence of characters are
+      // also sequences and are drawn separately
+      while (!extended &&
+             x+len <= rlx &&
+             _image[loc(x+len,y)].style == currentStyle &&
+             (x+len >= selectionLeft && x+len <= selectionRight) == selected &&
              (_image[ qMin(loc(x+len,y)+1,_imageSize) ].character == 0) == doubleWidth &&
              isLineChar( c = _image[loc(x+len,y)].character) == lineDraw) // Assignment!
       {
@@ -1361,11 +1472,15 @@ void TerminalDisplay::drawContents(QPainter &paint, const QRect &rect)
 		 QTransform inverted = paint.worldTransform().inverted();
 		 textArea.moveTopLeft( inverted.map(textArea.topLeft()) );
 		 
+		 Character style = _image[loc(x,y)];
+		 if (selected)
+			 style.style = CharacterStyleTable::instance()->reversed(style.style);
+
 		 //paint text fragment
          drawTextFragment(	paint,
                 		    textArea,
                 		    unistr, 
-					    	&_image[loc(x,y)] ); //, 
+					    	&style ); //,
 						    //0, 
 						    //!_isPrinting );
          
@@ -1493,10 +1608,17 @@ void TerminalDisplay::updateImageSize()
 //the same signal as the one for a content size change 
 void TerminalDisplay::showEvent(QShowEvent*)
 {
+    if ( _screenWindow )
+        _screenWindow->setVisible(true);
+
     emit changedContentSizeSignal(_contentHeight,_contentWidth);
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
 {
+    // updates of the display are deferred while it is hidden
+    if ( _screenWindow )
+        _screenWindow->setVisible(false);
+
     emit changedContentSizeSignal(_contentHeight,_contentWidth);
 }
 
@@ -2279,6 +2401,10 @@ bool TerminalDisplay::usesMouse() const
 
 #undef KeyPress
 
+// pastes longer than this ( in characters ) are sent to the terminal in chunks,
+// see pasteRequest()
+static const int LargePasteLength = 8192;
+
 void TerminalDisplay::emitSelection(bool useXselection,bool appendReturn)
 {
   if ( !_screenWindow ) 
@@ -2289,7 +2415,13 @@ void TerminalDisplay::emitSelection(bool useXselection,bool appendReturn)
                                                                  QClipboard::Clipboard);
   if(appendReturn)
     text.append("\r");
-  if ( ! text.isEmpty() )
+
+  if ( text.length() > LargePasteLength )
+  {
+    emit pasteRequest(text);
+    _screenWindow->clearSelection();
+  }
+  else if ( ! text.isEmpty() )
   {
     text.replace("\n", "\r");
     QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, text);
@@ -2543,12 +2675,10 @@ void TerminalDisplay::clearImage()
   for (int i = 0; i <= _imageSize; i++)
   {
     _image[i].character = ' ';
-    _image[i].foregroundColor = CharacterColor(COLOR_SPACE_DEFAULT,
-                                               DEFAULT_FORE_COLOR);
-    _image[i].backgroundColor = CharacterColor(COLOR_SPACE_DEFAULT,
-                                               DEFAULT_BACK_COLOR);
-    _image[i].rendition = DEFAULT_RENDITION;
+    _image[i].style = CharacterStyleTable::DefaultStyle;
   }
+
+  _imageGeneration = 0;
 }
 
 void TerminalDisplay::calcGeometry()
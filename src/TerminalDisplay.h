@@ -29,6 +29,7 @@
 // Konsole
 #include "Filter.h"
 #include "Character.h"
+#include "ScreenWindow.h"
 
 class QDrag;
 class QDragEnterEvent;
@@ -394,6 +395,16 @@ public:
     /** Returns the terminal screen section which is displayed in this widget.  See setScreenWindow() */
     ScreenWindow* screenWindow() const;
 
+    /** Returns the number of times the display has been painted. */
+    quint64 paintCount() const;
+    /** Returns the total time spent painting the display, in microseconds. */
+    qint64 paintTime() const;
+    /** 
+     * Returns the total time spent in updateImage() fetching changes
+     * from the screen window, in microseconds.
+     */
+    qint64 updateTime() const;
+
     static bool HAVE_TRANSPARENCY;
 
 public slots:
@@ -482,6 +493,13 @@ signals:
      */
     void keyPressedSignal(QKeyEvent *e);
 
+    /**
+     * Emitted instead of keyPressedSignal() when the user pastes a large block of
+     * text, which should be sent to the terminal a piece at a time.
+     * Newlines in @p text have not been converted to carriage returns.
+     */
+    void pasteRequest(const QString& text);
+
     /**
      * Emitted when the user presses the suspend or resume flow control key combinations 
      * 
@@ -643,6 +661,13 @@ private:
 	// a hotspot
 	QRegion hotSpotRegion() const;
 
+	// returns a region covering the lines of the display in which the selected
+	// characters differ between 'oldSelection' and 'newSelection'.  'scrolledLines'
+	// is the number of lines which the display was scrolled by in between.
+	QRegion selectionChangeRegion(const SelectionRange& oldSelection ,
+								  const SelectionRange& newSelection ,
+								  int scrolledLines) const;
+
 	// returns the position of the cursor in columns and lines
 	QPoint cursorPosition() const;
 
@@ -680,6 +705,9 @@ private:
     int _contentWidth;
     Character* _image; // [lines][columns]
                // only the area [usedLines][usedColumns] in the image contains valid data
+    qint64 _imageGeneration; // the generation of the screen window's image which _image was
+                             // last updated from, or 0 if _image has been changed since
+    SelectionRange _selection; // the selection which is drawn over _image
 
     int _imageSize;
     QVector<LineProperty> _lineProperties;
@@ -754,6 +782,11 @@ private:
     // color of the character under the cursor is used
     QColor _cursorColor;  
 
+    // see paintCount() , paintTime() , updateTime()
+    quint64 _paintCount;
+    qint64 _paintTime;
+    qint64 _updateTime;
+
 
     struct InputMethodData
     {
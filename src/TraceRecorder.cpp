@@ -0,0 +1,208 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "TraceRecorder.h"
+
+// System
+#include <unistd.h>
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+
+// KDE
+#include <kglobal.h>
+#include <KDebug>
+
+// Konsole
+#include "Stopwatch.h"
+
+using namespace Konsole;
+
+K_GLOBAL_STATIC( TraceRecorder , theTraceRecorder )
+
+// limits the memory used by a trace which is left recording.
+// spans recorded after this are discarded
+static const int MaximumSpanCount = 1000000;
+
+TraceRecorder* TraceRecorder::instance()
+{
+    if ( theTraceRecorder.isDestroyed() )
+        return 0;
+
+    return theTraceRecorder;
+}
+
+TraceRecorder::TraceRecorder()
+    : _recording(false)
+    , _startTime(0)
+    , _droppedSpans(0)
+{
+    const QByteArray fileName = qgetenv("KONSOLE_TRACE_FILE");
+    if ( !fileName.isEmpty() )
+        start(QFile::decodeName(fileName));
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    if ( _recording )
+        stop();
+}
+
+void TraceRecorder::start(const QString& fileName)
+{
+    if ( _recording )
+        stop();
+
+    QMutexLocker locker(&_mutex);
+
+    _fileName = fileName;
+    _startTime = Stopwatch::currentTime();
+    _droppedSpans = 0;
+    _spans.clear();
+    _threads.clear();
+    _threadNames.clear();
+    _recording = true;
+}
+
+bool TraceRecorder::stop()
+{
+    QMutexLocker locker(&_mutex);
+
+    if ( !_recording )
+        return true;
+
+    _recording = false;
+
+    if ( _droppedSpans > 0 )
+        kWarning() << "Trace was too long," << _droppedSpans << "spans were not recorded";
+
+    const bool written = writeTrace();
+
+    _spans.clear();
+    _spans.squeeze();
+
+    return written;
+}
+
+void TraceRecorder::addSpan(const char* name , qint64 startTime , qint64 duration)
+{
+    QMutexLocker locker(&_mutex);
+
+    if ( !_recording )
+        return;
+
+    if ( _spans.count() >= MaximumSpanCount )
+    {
+        _droppedSpans++;
+        return;
+    }
+
+    Span span;
+    span.name = name;
+    span.startTime = startTime - _startTime;
+    span.duration = duration;
+    span.thread = currentThread();
+
+    _spans.append(span);
+}
+
+int TraceRecorder::currentThread()
+{
+    const Qt::HANDLE handle = QThread::currentThreadId();
+
+    int id = _threads.value(handle,-1);
+    if ( id != -1 )
+        return id;
+
+    id = _threadNames.count();
+    _threads.insert(handle,id);
+
+    QCoreApplication* app = QCoreApplication::instance();
+    if ( app && QThread::currentThread() == app->thread() )
+        _threadNames.append("Main Thread");
+    else
+        _threadNames.append(QString("Thread %1").arg(id));
+
+    return id;
+}
+
+bool TraceRecorder::writeTrace()
+{
+    QFile file(_fileName);
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    {
+        kWarning() << "Unable to write trace to" << _fileName << ":" << file.errorString();
+        return false;
+    }
+
+    const qint64 pid = getpid();
+
+    QTextStream stream(&file);
+    stream << "{\"traceEvents\":[\n";
+
+    // name the threads so that the main thread can be told apart
+    // from the output processing threads
+    for ( int i = 0 ; i < _threadNames.count() ; i++ )
+    {
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+               << ",\"tid\":" << i << ",\"args\":{\"name\":\"" << _threadNames[i] << "\"}},\n";
+    }
+
+    for ( int i = 0 ; i < _spans.count() ; i++ )
+    {
+        const Span& span = _spans[i];
+        stream << "{\"name\":\"" << span.name << "\",\"cat\":\"konsole\",\"ph\":\"X\""
+               << ",\"ts\":" << span.startTime << ",\"dur\":" << span.duration
+               << ",\"pid\":" << pid << ",\"tid\":" << span.thread << "},\n";
+    }
+
+    // the list of events may not end with a comma, so finish with an
+    // event which marks the end of the trace
+    stream << "{\"name\":\"End of trace\",\"ph\":\"i\",\"s\":\"g\",\"ts\":"
+           << Stopwatch::currentTime() - _startTime << ",\"pid\":" << pid << ",\"tid\":0}\n";
+    stream << "],\"displayTimeUnit\":\"ms\"}\n";
+
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+TraceSpan::TraceSpan(const char* name)
+    : _name(name)
+    , _startTime(-1)
+{
+    TraceRecorder* recorder = TraceRecorder::instance();
+    if ( recorder && recorder->isRecording() )
+        _startTime = Stopwatch::currentTime();
+}
+
+TraceSpan::~TraceSpan()
+{
+    if ( _startTime < 0 )
+        return;
+
+    TraceRecorder* recorder = TraceRecorder::instance();
+    if ( recorder )
+        recorder->addSpan(_name,_startTime,Stopwatch::currentTime() - _startTime);
+}
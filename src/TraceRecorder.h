@@ -0,0 +1,137 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+namespace Konsole
+{
+
+/**
+ * Records the time spent in the various stages of reading, processing and
+ * displaying terminal output and writes it to a file in the Trace Event Format,
+ * which can be loaded into a trace viewer such as Chrome's about:tracing page.
+ *
+ * Unlike a sampling profiler, the trace shows how the work done for
+ * different sessions, timers and painting is interleaved by the event loop
+ * and the output processing threads.
+ *
+ * Each traced piece of work is marked with a TraceSpan.  Recording is
+ * disabled by default and can be started by setting the KONSOLE_TRACE_FILE
+ * environment variable to the name of the file to write the trace to, or by
+ * calling start().  The trace is written when recording is stopped, or when
+ * the application exits.
+ *
+ * This class is thread-safe.
+ */
+class TraceRecorder
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    /**
+     * Returns the global trace recorder.  This returns 0 once the recorder
+     * has been destroyed when the application exits.
+     */
+    static TraceRecorder* instance();
+
+    /**
+     * Starts recording.  The trace will be written to @p fileName when
+     * recording stops.  If a trace is already being recorded, it is
+     * written out first.
+     */
+    void start(const QString& fileName);
+    /**
+     * Stops recording and writes the recorded events to the file specified
+     * in the call to start().  Returns false if the file could not be written.
+     */
+    bool stop();
+    /** Returns true if the recorder is recording events. */
+    bool isRecording() const { return _recording; }
+
+    /**
+     * Records a span of work called @p name which started at @p startTime and
+     * lasted for @p duration microseconds, on the current thread.  Times
+     * are values returned by Stopwatch::currentTime().
+     *
+     * @p name must remain valid until the trace is written, usually it
+     * is a string literal.
+     */
+    void addSpan(const char* name , qint64 startTime , qint64 duration);
+
+private:
+    struct Span
+    {
+        const char* name;
+        qint64 startTime;
+        qint64 duration;
+        int thread;
+    };
+
+    // returns a small integer which identifies the current thread in the trace
+    int currentThread();
+    bool writeTrace();
+
+    mutable QMutex _mutex;
+    volatile bool _recording;
+    QString _fileName;
+    qint64 _startTime;
+    int _droppedSpans;
+
+    QVector<Span> _spans;
+    QHash<Qt::HANDLE,int> _threads;
+    QVector<QString> _threadNames;
+};
+
+/**
+ * Records the time from its construction until its destruction as a span of
+ * work in the trace, if a trace is being recorded.  Place a TraceSpan at the
+ * start of the function or block to be traced:
+ *
+ * @code
+ * void Screen::addHistLine()
+ * {
+ *     TraceSpan span("Screen::addHistLine");
+ *     ...
+ * }
+ * @endcode
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+
+private:
+    const char* _name;
+    qint64 _startTime;
+};
+
+}
+
+#endif // TRACERECORDER_H
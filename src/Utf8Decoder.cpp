@@ -0,0 +1,124 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Utf8Decoder.h"
+
+using namespace Konsole;
+
+static const ushort ReplacementCharacter = 0xFFFD;
+
+Utf8Decoder::Utf8Decoder()
+    : _codePoint(0)
+    , _pendingBytes(0)
+    , _minimumCodePoint(0)
+{
+}
+
+void Utf8Decoder::reset()
+{
+    _codePoint = 0;
+    _pendingBytes = 0;
+    _minimumCodePoint = 0;
+}
+
+int Utf8Decoder::decode(const char* data, int length, ushort* output)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    ushort* out = output;
+    int i = 0;
+
+    while ( i < length )
+    {
+        // ASCII characters, which make up most terminal output, are copied as-is
+        if ( _pendingBytes == 0 )
+        {
+            while ( i < length && bytes[i] < 0x80 )
+                *out++ = bytes[i++];
+
+            if ( i == length )
+                break;
+        }
+
+        const uchar c = bytes[i];
+
+        if ( _pendingBytes > 0 )
+        {
+            if ( (c & 0xC0) == 0x80 )
+            {
+                _codePoint = (_codePoint << 6) | (c & 0x3F);
+                i++;
+
+                if ( --_pendingBytes > 0 )
+                    continue;
+
+                if ( _codePoint < _minimumCodePoint || _codePoint > 0x10FFFF ||
+                     (_codePoint >= 0xD800 && _codePoint <= 0xDFFF) )
+                {
+                    *out++ = ReplacementCharacter;
+                }
+                else if ( _codePoint >= 0x10000 )
+                {
+                    *out++ = 0xD800 + ((_codePoint - 0x10000) >> 10);
+                    *out++ = 0xDC00 + ((_codePoint - 0x10000) & 0x3FF);
+                }
+                else
+                {
+                    *out++ = _codePoint;
+                }
+                continue;
+            }
+
+            // the sequence was cut short, the current byte is decoded afresh
+            *out++ = ReplacementCharacter;
+            _pendingBytes = 0;
+            continue;
+        }
+
+        i++;
+
+        if ( (c & 0xE0) == 0xC0 )
+        {
+            _codePoint = c & 0x1F;
+            _pendingBytes = 1;
+            _minimumCodePoint = 0x80;
+        }
+        else if ( (c & 0xF0) == 0xE0 )
+        {
+            _codePoint = c & 0x0F;
+            _pendingBytes = 2;
+            _minimumCodePoint = 0x800;
+        }
+        else if ( (c & 0xF8) == 0xF0 )
+        {
+            _codePoint = c & 0x07;
+            _pendingBytes = 3;
+            _minimumCodePoint = 0x10000;
+        }
+        else
+        {
+            // unexpected continuation byte or invalid lead byte
+            *out++ = ReplacementCharacter;
+        }
+    }
+
+    return out - output;
+}
@@ -0,0 +1,86 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef UTF8DECODER_H
+#define UTF8DECODER_H
+
+// Qt
+#include <QtCore/QtGlobal>
+
+namespace Konsole
+{
+
+/**
+ * An incremental decoder which converts a stream of UTF-8 encoded bytes into
+ * UTF-16 characters.
+ *
+ * Unlike QTextDecoder, the decoder writes its output into a buffer supplied
+ * by the caller and does not allocate any memory.  The stream can be passed
+ * to decode() in blocks of any size, multi-byte sequences which are split
+ * across the end of a block are completed when the next block is decoded.
+ *
+ * Characters outside the Basic Multilingual Plane are converted into
+ * surrogate pairs.  Invalid and overlong sequences are replaced by
+ * the U+FFFD replacement character.
+ */
+class Utf8Decoder
+{
+public:
+    /** Constructs a new decoder. */
+    Utf8Decoder();
+
+    /**
+     * Decodes @p length bytes from @p data and writes the resulting characters to
+     * @p output.  @p output must have room for at least maximumOutputLength(@p length)
+     * characters.
+     *
+     * Returns the number of characters written to @p output.
+     */
+    int decode(const char* data, int length, ushort* output);
+
+    /**
+     * Returns the maximum number of characters which decode() will produce
+     * for an input of @p length bytes.
+     */
+    static int maximumOutputLength(int length) { return length+1; }
+
+    /** Discards any incomplete multi-byte sequence from a previous call to decode(). */
+    void reset();
+
+    /**
+     * Returns true if the last block passed to decode() ended with
+     * an incomplete multi-byte sequence.
+     */
+    bool hasPendingBytes() const { return _pendingBytes > 0; }
+
+private:
+    // value of the sequence which is currently being decoded
+    uint _codePoint;
+    // number of continuation bytes still needed to complete the sequence
+    int _pendingBytes;
+    // smallest code point which may be encoded by a sequence of the current
+    // length, used to reject overlong sequences
+    uint _minimumCodePoint;
+};
+
+}
+
+#endif // UTF8DECODER_H
@@ -43,12 +43,15 @@
 #include <QtCore/QEvent>
 #include <QtGui/QKeyEvent>
 #include <QtCore/QByteRef>
+#include <QtCore/QVarLengthArray>
 
 // KDE
 #include <kdebug.h>
 #include <klocale.h>
 
 // Konsole
+#include "CharacterScanner.h"
+#include "EmulationThreadPool.h"
 #include "KeyboardTranslator.h"
 #include "Screen.h"
 
@@ -101,6 +104,8 @@ Vt102Emulation::~Vt102Emulation()
 
 void Vt102Emulation::clearEntireScreen()
 {
+  QMutexLocker locker(&_lock);
+
   _currentScreen->clearEntireScreen();
 
   bufferedUpdate(); 
@@ -108,6 +113,8 @@ void Vt102Emulation::clearEntireScreen()
 
 void Vt102Emulation::reset()
 {
+  QMutexLocker locker(&_lock);
+
   //kDebug(1211)<<"Vt102Emulation::reset() resetToken()";
   resetToken();
   //kDebug(1211)<<"Vt102Emulation::reset() resetModes()";
@@ -119,7 +126,8 @@ void Vt102Emulation::reset()
   //kDebug(1211)<<"Vt102Emulation::reset() resetCharSet()";
   resetCharset(1);
   //kDebug(1211)<<"Vt102Emulation::reset() reset _screen 1";
-  _screen[1]->reset();
+  if ( _screen[1] )
+      _screen[1]->reset();
   //kDebug(1211)<<"Vt102Emulation::reset() setCodec()";
   setCodec(LocaleCodec);
   //kDebug(1211)<<"Vt102Emulation::reset() done";
@@ -206,14 +214,15 @@ void Vt102Emulation::reset()
 
 /* The tokenizers state
 
-   The state is represented by the buffer (pbuf, ppos),
-   and accompanied by decoded arguments kept in (argv,argc).
+   The state is represented by the parser state (_parserState), the buffer
+   (pbuf, ppos), and accompanied by decoded arguments kept in (argv,argc).
    Note that they are kept internal in the tokenizer.
 */
 
 void Vt102Emulation::resetToken()
 {
   ppos = 0; argc = 0; argv[0] = 0; argv[1] = 0;
+  _parserState = GroundState;
 }
 
 void Vt102Emulation::addDigit(int dig)
@@ -243,6 +252,16 @@ void Vt102Emulation::pushToToken(int cc)
 #define GRP 32
 #define CPS 64
 
+#define ESC 27
+#define CNTL(c) ((c)-'@')
+
+// Entries of the transition table hold the action to perform in the
+// low byte and the state to continue in in the high byte.
+
+#define TRANSITION(A,S)   ((A) | ((S) << 8))
+#define TR_ACTION(T)      ((T) & 0xff)
+#define TR_STATE(T)       ((T) >> 8)
+
 void Vt102Emulation::initTokenizer()
 { int i; quint8* s;
   for(i =  0;                      i < 256; i++) tbl[ i]  = 0;
@@ -254,108 +273,315 @@ void Vt102Emulation::initTokenizer()
   for(s = (quint8*)"0123456789"        ; *s; s++) tbl[*s] |= DIG;
   for(s = (quint8*)"()+*%"             ; *s; s++) tbl[*s] |= SCS;
   for(s = (quint8*)"()+*#[]%"          ; *s; s++) tbl[*s] |= GRP;
+
+  initTransitions();
   resetToken();
 }
 
-/* Ok, here comes the nasty part of the decoder.
-
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
+/* The parser
+
+   Incoming characters drive an explicit state machine, modelled on the
+   parser of the DEC VT500 series.  For each state, the transition table
+   holds the action to perform for every character together with the
+   state to continue in, so that every character is handled with a single
+   table lookup instead of rescanning the token collected so far.
+
+   The table is derived from the character classes in 'tbl':
+
+   - Control characters (CTL) are executed in any state without affecting
+     the sequence being scanned (DEC HACK ALERT! Control characters are
+     allowed *within* escape sequences in VT100).  ESC starts a new escape
+     sequence and CAN and SUB abort the current one.  BEL terminates an
+     xterm OSC string.
+   - In the escape state, GRP characters lead to the states which scan
+     character set selections (SCS), DEC line attributes ('#'), control
+     sequences ('[') or xterm OSC strings (']').  All other characters
+     complete the escape sequence.
+   - In the control sequence states, digits (DIG) and ';' collect the
+     arguments.  A leading '?', '>' or '!' selects the kind of sequence
+     and the next CPN, CPS or other character completes it.
+
+   Characters with codes above 255 are classified like 255 (a printable
+   character of no other class).
+*/
 
-   This is done by the following defines.
+void Vt102Emulation::initTransitions()
+{
+  int state;
+  int i;
 
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'tbl').
+  for (state = 0; state < ParserStateCount; state++)
+  {
+    ushort* t = _transitions[state];
 
-   Note that they need to applied in proper order.
-*/
+    // printable characters
+    for (i = 32; i < 256; i++)
+    {
+      switch (state)
+      {
+        case GroundState:
+          t[i] = TRANSITION(PrintAction,GroundState);
+          break;
+        case EscapeState:
+          if (tbl[i] & SCS)
+            t[i] = TRANSITION(CollectAction,CharsetSelectState);
+          else if (i == '#')
+            t[i] = TRANSITION(CollectAction,LineAttributeState);
+          else if (i == '[')
+            t[i] = TRANSITION(CollectAction,CsiEntryState);
+          else if (i == ']')
+            t[i] = TRANSITION(CollectAction,OscStringState);
+          else
+            t[i] = TRANSITION(EscDispatchAction,GroundState);
+          break;
+        case CharsetSelectState:
+          t[i] = TRANSITION(CharsetDispatchAction,GroundState);
+          break;
+        case LineAttributeState:
+          t[i] = TRANSITION(LineAttributeDispatchAction,GroundState);
+          break;
+        case CsiEntryState:
+        case CsiParamState:
+        case CsiPrivateParamState:
+        case CsiSecondaryParamState:
+          if (tbl[i] & DIG)
+            t[i] = TRANSITION(DigitAction,state == CsiEntryState ? CsiParamState : state);
+          else if (i == ';')
+            t[i] = TRANSITION(SeparatorAction,state == CsiEntryState ? CsiParamState : state);
+          else if (state == CsiPrivateParamState)
+            t[i] = TRANSITION(CsiPrivateDispatchAction,GroundState);
+          else if (state == CsiSecondaryParamState)
+            t[i] = TRANSITION(CsiSecondaryDispatchAction,GroundState);
+          else if (tbl[i] & CPN)
+            t[i] = TRANSITION(CsiPnDispatchAction,GroundState);
+          else if (tbl[i] & CPS)
+            t[i] = TRANSITION(CsiPsResizeDispatchAction,GroundState);
+          else
+            t[i] = TRANSITION(CsiPsDispatchAction,GroundState);
+          break;
+        case CsiExclamationState:
+          t[i] = TRANSITION(CsiExclamationDispatchAction,GroundState);
+          break;
+        case OscStringState:
+          t[i] = TRANSITION(CollectAction,OscStringState);
+          break;
+        case Vt52EscapeState:
+          if (i == 'Y')
+            t[i] = TRANSITION(CollectAction,Vt52RowState);
+          else
+            t[i] = TRANSITION(Vt52DispatchAction,GroundState);
+          break;
+        case Vt52RowState:
+          t[i] = TRANSITION(CollectAction,Vt52ColumnState);
+          break;
+        case Vt52ColumnState:
+          t[i] = TRANSITION(Vt52CursorDispatchAction,GroundState);
+          break;
+      }
+    }
 
-#define lec(P,L,C) (p == (P) &&                     s[(L)]         == (C))
-#define lun(     ) (p ==  1  &&                       cc           >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256  && (tbl[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  &&        cc                          == (C))
-#define ees(C)     (p >=  3  && cc < 256 &&    (tbl[  cc  ] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (tbl[  cc  ] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?'                              )
-#define epe( )     (p >=  3  && s[2] == '!'                              )
-#define egt(     ) (p >=  3  && s[2] == '>'                              )
-#define Xpe        (ppos>=2  && pbuf[1] == ']'                           )
-#define Xte        (Xpe                        &&     cc           ==  7 )
-#define ces(C)     (            cc < 256 &&    (tbl[  cc  ] & (C)) == (C) && !Xte)
+    // the leading character of a control sequence selects its kind
+    if (state == CsiEntryState)
+    {
+      t['?'] = TRANSITION(CollectAction,CsiPrivateParamState);
+      t['>'] = TRANSITION(CollectAction,CsiSecondaryParamState);
+      t['!'] = TRANSITION(CollectAction,CsiExclamationState);
+    }
 
-#define ESC 27
-#define CNTL(c) ((c)-'@')
+    // 8-bit CSI
+    if (state == GroundState)
+      t[ESC+128] = TRANSITION(Csi8BitAction,GroundState);
+
+    // control characters
+    for (i = 0; i < 32; i++)
+      t[i] = TRANSITION(ExecuteAction,state);
+    t[CNTL('X')] = TRANSITION(CancelAction,GroundState); //VT100: CAN
+    t[CNTL('Z')] = TRANSITION(CancelAction,GroundState); //VT100: SUB
+    t[ESC]       = TRANSITION(EscapeAction,EscapeState);
+    if (state == OscStringState)
+      t[CNTL('G')] = TRANSITION(OscDispatchAction,GroundState);
+  }
+}
 
 // process an incoming unicode character
 
 void Vt102Emulation::receiveChar(int cc)
-{ 
+{
   int i;
   if (cc == 127) return; //VT100: ignore.
 
-  if (ces(    CTL))
-  { // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetToken nor a pushToToken. Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC) resetToken(); //VT100: CAN or SUB
-    if (cc != ESC)    { tau( TY_CTL(cc+'@' ),   0,  0); return; }
-  }
+  int transition = _transitions[_parserState][cc < 256 ? cc : 255];
+  int action = TR_ACTION(transition);
+  _parserState = TR_STATE(transition);
 
-  pushToToken(cc); // advance the state
+  if (action >= CollectAction)
+    pushToToken(cc); // advance the token
 
-  int* s = pbuf;
-  int  p = ppos;
+  if (action >= EscDispatchAction)
+    _escapeSequences++;
 
-  if (getMode(MODE_Ansi)) // decide on proper action
+  switch (action)
   {
-    if (lec(1,0,ESC)) {                                                       return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('[');                   return; }
-    if (les(2,1,GRP)) {                                                       return; }
-    if (Xte         ) { XtermHack();                            resetToken(); return; }
-    if (Xpe         ) {                                                       return; }
-    if (lec(3,2,'?')) {                                                       return; }
-    if (lec(3,2,'>')) {                                                       return; }
-    if (lec(3,2,'!')) {                                                       return; }
-    if (lun(       )) { tau( TY_CHR(), applyCharset(cc), 0); resetToken(); return; }
-    if (lec(2,0,ESC)) { tau( TY_ESC(s[1]),   0,  0);       resetToken(); return; }
-    if (les(3,1,SCS)) { tau( TY_ESC_CS(s[1],s[2]),   0,  0);  resetToken(); return; }
-    if (lec(3,1,'#')) { tau( TY_ESC_DE(s[2]),   0,  0);       resetToken(); return; }
-    if (eps(    CPN)) { tau( TY_CSI_PN(cc), argv[0],argv[1]);   resetToken(); return; }
+    case PrintAction:
+      if (getMode(MODE_Ansi))
+        tau( TY_CHR(), applyCharset(cc), 0);
+      else
+        tau( TY_CHR(), cc, 0);
+      break;
+
+    case ExecuteAction:
+      tau( TY_CTL(cc+'@' ), 0, 0);
+      break;
+
+    case CancelAction:
+      resetToken();
+      tau( TY_CTL(cc+'@' ), 0, 0);
+      break;
+
+    case EscapeAction:
+      resetToken();
+      pushToToken(cc);
+      _parserState = getMode(MODE_Ansi) ? EscapeState : Vt52EscapeState;
+      break;
+
+    case Csi8BitAction:
+      if (getMode(MODE_Ansi))
+      {
+        pushToToken(ESC);
+        pushToToken('[');
+        _parserState = CsiEntryState;
+      }
+      else
+      {
+        tau( TY_CHR(), cc, 0);
+      }
+      break;
+
+    case CollectAction:
+      break;
+
+    case DigitAction:
+      addDigit(cc-'0');
+      break;
+
+    case SeparatorAction:
+      addArgument();
+      break;
+
+    case EscDispatchAction:
+      tau( TY_ESC(cc), 0, 0);
+      resetToken();
+      break;
+
+    case CharsetDispatchAction:
+      tau( TY_ESC_CS(pbuf[1],cc), 0, 0);
+      resetToken();
+      break;
+
+    case LineAttributeDispatchAction:
+      tau( TY_ESC_DE(cc), 0, 0);
+      resetToken();
+      break;
+
+    case CsiPnDispatchAction:
+      tau( TY_CSI_PN(cc), argv[0], argv[1]);
+      resetToken();
+      break;
 
 // resize = \e[8;<row>;<col>t
-    if (eps(    CPS)) { tau( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);   resetToken(); return; }
-
-    if (epe(       )) { tau( TY_CSI_PE(cc),     0,  0);       resetToken(); return; }
-    if (ees(    DIG)) { addDigit(cc-'0');                                     return; }
-    if (eec(    ';')) { addArgument();                                        return; }
-    for (i=0;i<=argc;i++)
-    if ( epp(     ))  { tau( TY_CSI_PR(cc,argv[i]),   0,  0); }
-    else if(egt(    ))   { tau( TY_CSI_PG(cc     ),   0,  0); } // spec. case for ESC]>0c or ESC]>c
-    else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
-    { // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
-      i += 2;
-      tau( TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
-      i += 2;
-    }
-    else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
-    { // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
-      i += 2;
-      tau( TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
-    }
-    else              { tau( TY_CSI_PS(cc,argv[i]),   0,  0); }
-    resetToken();
+    case CsiPsResizeDispatchAction:
+      tau( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+      resetToken();
+      break;
+
+    case CsiExclamationDispatchAction:
+      tau( TY_CSI_PE(cc), 0, 0);
+      resetToken();
+      break;
+
+    case CsiPrivateDispatchAction:
+      for (i=0;i<=argc;i++)
+        tau( TY_CSI_PR(cc,argv[i]), 0, 0);
+      resetToken();
+      break;
+
+    case CsiSecondaryDispatchAction:
+      for (i=0;i<=argc;i++)
+        tau( TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
+      resetToken();
+      break;
+
+    case CsiPsDispatchAction:
+      for (i=0;i<=argc;i++)
+      if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
+      { // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
+        i += 2;
+        tau( TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
+        i += 2;
+      }
+      else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
+      { // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
+        i += 2;
+        tau( TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+      }
+      else              { tau( TY_CSI_PS(cc,argv[i]),   0,  0); }
+      resetToken();
+      break;
+
+    case OscDispatchAction:
+      XtermHack();
+      resetToken();
+      break;
+
+    case Vt52DispatchAction:
+      tau( TY_VT52(cc), 0, 0);
+      resetToken();
+      break;
+
+    case Vt52CursorDispatchAction:
+      tau( TY_VT52(pbuf[1]), pbuf[2], pbuf[3]);
+      resetToken();
+      break;
   }
-  else // mode VT52
+}
+
+// characters which are shown as-is when no escape sequence is being scanned.
+// this must match the transitions of GroundState
+static inline bool isPrintableChar(int cc)
+{
+  return cc >= 32 && cc != 127 && cc != ESC+128;
+}
+
+// process a block of incoming unicode characters
+//
+// runs of printable characters which arrive while no token is being scanned
+// are passed to the screen in one go instead of going through receiveChar()
+// and tau() one character at a time.
+
+void Vt102Emulation::receiveChars(const ushort* chars, int count)
+{
+  int i = 0;
+  while (i < count)
   {
-    if (lec(1,0,ESC))                                                      return;
-    if (les(1,0,CHR)) { tau( TY_CHR(       ), s[0],  0); resetToken(); return; }
-    if (lec(2,1,'Y'))                                                      return;
-    if (lec(3,1,'Y'))                                                      return;
-    if (p < 4)        { tau( TY_VT52(s[1]   ),   0,  0); resetToken(); return; }
-                        tau( TY_VT52(s[1]   ), s[2],s[3]); resetToken(); return;
+    if (_parserState == GroundState && isPrintableChar(chars[i]) && getMode(MODE_Ansi))
+    {
+      int start = i;
+      for (;;)
+      {
+        i += findControlCharacter(chars+i,count-i);
+
+        // C1 characters other than CSI do not end the run
+        if (i < count && isPrintableChar(chars[i]))
+          i++;
+        else
+          break;
+      }
+      showPrintableRun(chars+start,i-start);
+    }
+    else
+    {
+      receiveChar(chars[i++]);
+    }
   }
 }
 
@@ -372,13 +598,20 @@ void Vt102Emulation::XtermHack()
   // (btw: arg=0 changes title and icon, arg=1 only icon, arg=2 only title
 //  emit changeTitle(arg,unistr);
   _pendingTitleUpdates[arg] = unistr;
-  _titleUpdateTimer->start(20);
+
+  // the timer can only be started from the thread which it belongs to
+  if ( inOwnThread() )
+    _titleUpdateTimer->start(20);
+  else
+    QMetaObject::invokeMethod(_titleUpdateTimer,"start",Qt::QueuedConnection,Q_ARG(int,20));
 
   delete [] str;
 }
 
 void Vt102Emulation::updateTitle()
 {
+	QMutexLocker locker(&_lock);
+
 	QListIterator<int> iter( _pendingTitleUpdates.keys() );
 	while (iter.hasNext()) {
 		int arg = iter.next();
@@ -743,7 +976,7 @@ switch( N )
     case TY_CSI_PR('r', 1003) :      restoreMode      (MODE_Mouse1003); break; //XTERM
 
     case TY_CSI_PR('h', 1047) :          setMode      (MODE_AppScreen); break; //XTERM
-    case TY_CSI_PR('l', 1047) : _screen[1]->clearEntireScreen(); resetMode(MODE_AppScreen); break; //XTERM
+    case TY_CSI_PR('l', 1047) : if (_screen[1]) _screen[1]->clearEntireScreen(); resetMode(MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('s', 1047) :         saveMode      (MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('r', 1047) :      restoreMode      (MODE_AppScreen); break; //XTERM
 
@@ -755,7 +988,7 @@ switch( N )
 
     //FIXME: every once new sequences like this pop up in xterm.
     //       Here's a guess of what they could mean.
-    case TY_CSI_PR('h', 1049) : saveCursor(); _screen[1]->clearEntireScreen(); setMode(MODE_AppScreen); break; //XTERM
+    case TY_CSI_PR('h', 1049) : saveCursor(); alternateScreen()->clearEntireScreen(); setMode(MODE_AppScreen); break; //XTERM
     case TY_CSI_PR('l', 1049) : resetMode(MODE_AppScreen); restoreCursor(); break; //XTERM
 
     //FIXME: weird DEC reset sequence
@@ -813,10 +1046,17 @@ void Vt102Emulation::clearScreenAndSetColumns(int columnCount)
 
 void Vt102Emulation::sendString(const char* s , int length)
 {
-  if ( length >= 0 )
+  if ( length < 0 )
+    length = strlen(s);
+
+  // replies to enquiries are generated whilst processing output, which may
+  // be happening on another thread.  @p s is usually a temporary buffer, so
+  // it is copied before being passed to the emulation's thread
+  if ( inOwnThread() )
     emit sendData(s,length);
   else
-    emit sendData(s,strlen(s));
+    QMetaObject::invokeMethod(this,"sendBufferedData",Qt::QueuedConnection,
+                              Q_ARG(QByteArray,QByteArray(s,length)));
 }
 
 // Replies ----------------------------------------------------------------- --
@@ -909,6 +1149,9 @@ void Vt102Emulation::reportAnswerBack()
 void Vt102Emulation::sendMouseEvent( int cb, int cx, int cy , int eventType )
 { char tmp[20];
   if (  cx<1 || cy<1 ) return;
+
+  QMutexLocker locker(&_lock);
+
   // normal buttons are passed as 0x20 + button,
   // mouse wheel (buttons 4,5) as 0x5c + button
   if (cb >= 4) cb += 0x3c;
@@ -940,6 +1183,8 @@ void Vt102Emulation::sendText( const QString& text )
 
 void Vt102Emulation::sendKeyEvent( QKeyEvent* event )
 {
+    QMutexLocker locker(&_lock);
+
     Qt::KeyboardModifiers modifiers = event->modifiers();
     KeyboardTranslator::States states = KeyboardTranslator::NoState;
 
@@ -998,8 +1243,12 @@ void Vt102Emulation::sendKeyEvent( QKeyEvent* event )
                                          "into characters to send to the terminal " 
                                          "is missing.");
 
-        reset();
-        receiveData( translatorError.toAscii().constData() , translatorError.count() );
+        // the terminal is reset with RIS rather than by calling reset(), so
+        // that the reset is made after any output which is still waiting
+        // to be processed
+        QByteArray text("\033c");
+        text.append( translatorError.toAscii() );
+        EmulationThreadPool::instance()->receiveData( this , text.constData() , text.length() );
     }
 }
 
@@ -1029,6 +1278,16 @@ void Vt102Emulation::sendKeyEvent( QKeyEvent* event )
 
 #define CHARSET _charset[_currentScreen==_screen[1]]
 
+// assert for i in [0..31] : vt100extended(vt100_graphics[i]) == i.
+
+unsigned short Konsole::vt100_graphics[32] =
+{ // 0/8     1/9    2/10    3/11    4/12    5/13    6/14    7/15
+  0x0020, 0x25C6, 0x2592, 0x2409, 0x240c, 0x240d, 0x240a, 0x00b0,
+  0x00b1, 0x2424, 0x240b, 0x2518, 0x2510, 0x250c, 0x2514, 0x253c,
+  0xF800, 0xF801, 0x2500, 0xF803, 0xF804, 0x251c, 0x2524, 0x2534,
+  0x252c, 0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00b7
+};
+
 // Apply current character map.
 
 unsigned short Vt102Emulation::applyCharset(unsigned short c)
@@ -1038,6 +1297,20 @@ unsigned short Vt102Emulation::applyCharset(unsigned short c)
   return c;
 }
 
+void Vt102Emulation::showPrintableRun(const ushort* chars, int count)
+{
+  if (!CHARSET.graphic && !CHARSET.pound)
+  {
+    _currentScreen->displayCharacters(chars,count);
+    return;
+  }
+
+  QVarLengthArray<ushort,256> mapped(count);
+  for (int i=0;i<count;i++)
+    mapped[i] = applyCharset(chars[i]);
+  _currentScreen->displayCharacters(mapped.constData(),count);
+}
+
 /*
    "Charset" related part of the emulation state.
    This configures the VT100 _charset filter.
@@ -1078,13 +1351,35 @@ void Vt102Emulation::useCharset(int n)
 void Vt102Emulation::setDefaultMargins()
 {
 	_screen[0]->setDefaultMargins();
-	_screen[1]->setDefaultMargins();
+	if ( _screen[1] )
+		_screen[1]->setDefaultMargins();
 }
 
 void Vt102Emulation::setMargins(int t, int b)
 {
   _screen[0]->setMargins(t, b);
-  _screen[1]->setMargins(t, b);
+  if ( _screen[1] )
+      _screen[1]->setMargins(t, b);
+}
+
+void Vt102Emulation::initAlternateScreen(Screen* screen)
+{
+  // apply the modes and margins which setMode() and setMargins()
+  // share between both screens
+  Screen* primary = _screen[0];
+
+  static const int sharedModes[] = { MODE_Cursor , MODE_NewLine };
+  for ( uint i = 0 ; i < sizeof(sharedModes)/sizeof(int) ; i++ )
+  {
+    if ( primary->getMode(sharedModes[i]) )
+        screen->setMode(sharedModes[i]);
+    else
+        screen->resetMode(sharedModes[i]);
+  }
+
+  if ( screen->topMargin() != primary->topMargin() ||
+       screen->bottomMargin() != primary->bottomMargin() )
+      screen->setMargins(primary->topMargin()+1,primary->bottomMargin()+1);
 }
 
 /*! Save the cursor position and the rendition attribute settings. */
@@ -1154,14 +1449,15 @@ void Vt102Emulation::setMode(int m)
  	    emit programUsesMouseChanged(false); 
     break;
 
-    case MODE_AppScreen : _screen[1]->clearSelection();
+    case MODE_AppScreen : alternateScreen()->clearSelection();
                           setScreen(1);
     break;
   }
   if (m < MODES_SCREEN || m == MODE_NewLine)
   {
     _screen[0]->setMode(m);
-    _screen[1]->setMode(m);
+    if ( _screen[1] )
+        _screen[1]->setMode(m);
   }
 }
 
@@ -1184,7 +1480,8 @@ void Vt102Emulation::resetMode(int m)
   if (m < MODES_SCREEN || m == MODE_NewLine)
   {
     _screen[0]->resetMode(m);
-    _screen[1]->resetMode(m);
+    if ( _screen[1] )
+        _screen[1]->resetMode(m);
   }
 }
 
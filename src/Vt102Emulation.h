@@ -106,6 +106,8 @@ protected:
 
   // reimplemented 
   virtual void receiveChar(int cc);
+  virtual void receiveChars(const ushort* chars, int count);
+  virtual void initAlternateScreen(Screen* screen);
   
 
 private slots:
@@ -117,6 +119,9 @@ private slots:
 
 private:
   unsigned short applyCharset(unsigned short c);
+  // maps a run of printable characters through the current charset
+  // and displays them on the current screen
+  void showPrintableRun(const ushort* chars, int count);
   void setCharset(int n, int cs);
   void useCharset(int n);
   void setAndUseCharset(int n, int cs);
@@ -150,6 +155,58 @@ private:
   void initTokenizer();
   int tbl[256];
 
+  // states of the escape sequence parser, see receiveChar()
+  enum ParserState
+  {
+    GroundState,
+    EscapeState,
+    CharsetSelectState,
+    LineAttributeState,
+    CsiEntryState,
+    CsiParamState,
+    CsiPrivateParamState,
+    CsiSecondaryParamState,
+    CsiExclamationState,
+    OscStringState,
+    Vt52EscapeState,
+    Vt52RowState,
+    Vt52ColumnState,
+    ParserStateCount
+  };
+
+  // actions performed by the parser when a character is received.
+  // the actions from CollectAction onwards add the character to the token
+  enum ParserAction
+  {
+    PrintAction,
+    ExecuteAction,
+    CancelAction,
+    EscapeAction,
+    Csi8BitAction,
+    CollectAction,
+    DigitAction,
+    SeparatorAction,
+    EscDispatchAction,
+    CharsetDispatchAction,
+    LineAttributeDispatchAction,
+    CsiPnDispatchAction,
+    CsiPsDispatchAction,
+    CsiPsResizeDispatchAction,
+    CsiPrivateDispatchAction,
+    CsiSecondaryDispatchAction,
+    CsiExclamationDispatchAction,
+    OscDispatchAction,
+    Vt52DispatchAction,
+    Vt52CursorDispatchAction
+  };
+
+  // builds the transition table from the character classes in tbl
+  void initTransitions();
+  // action and next state for each parser state and character, 
+  // see TRANSITION() in Vt102Emulation.cpp
+  ushort _transitions[ParserStateCount][256];
+  int _parserState;
+
   void scan_buffer_report(); //FIXME: rename
   void ReportErrorToken();   //FIXME: rename
 
@@ -0,0 +1,382 @@
+/*
+    This file is part of Konsole, KDE's terminal.
+
+    Copyright (C) 2026 by The Konsole Developers <konsole-devel@kde.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+   konsole-bench feeds byte streams through the terminal emulation
+   (Vt102Emulation, Screen and a history store) without a terminal display
+   and reports the throughput for each stream.
+
+   usage: konsole-bench [options] [corpus|file ...]
+
+   options:
+     --history <type>   history store, one of none, buffer:<lines>, file,
+                        blockarray:<KB> or compressed[:<lines>] (default buffer:1000)
+     --size <MB>        amount of data generated for each built-in corpus (default 16)
+     --chunk <bytes>    size of the blocks passed to the emulation (default 4096)
+     --lines <n>        number of screen lines (default 40)
+     --columns <n>      number of screen columns (default 80)
+
+   the built-in corpora are 'ascii', 'sgr', 'cjk', 'scroll' and 'vttest',
+   all of them are run if no corpus or file is given.  any other argument is
+   read as a file containing a recorded byte stream, or a capture made with
+   'konsole --capture'.  captures are replayed as fast as possible, with the
+   screen resized as recorded and the data passed to the emulation in the
+   blocks in which it was originally received.
+
+   lines/s is the number of newline characters in the stream processed 
+   per second.
+*/
+
+// System
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+// Qt
+#include <QtCore/QByteArray>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QTextCodec>
+
+// KDE
+#include <KComponentData>
+
+// Konsole
+#include "History.h"
+#include "PtyCapture.h"
+#include "Vt102Emulation.h"
+
+using namespace Konsole;
+
+static const char* const BuiltinCorpora[] = { "ascii" , "sgr" , "cjk" , "scroll" , "vttest" , 0 };
+
+static const char* const Words[] =
+{
+    "konsole" , "terminal" , "emulation" , "screen" , "history" , "warning:" , "unused" ,
+    "variable" , "include" , "src/Screen.cpp:42:" , "return" , "const" , "QString" , "0x7f" ,
+    "error" , "the" , "quick" , "brown" , "fox" , "jumps" , "over" , "lazy" , "dog" , 0
+};
+static const int WordCount = sizeof(Words) / sizeof(Words[0]) - 1;
+
+// simple deterministic pseudo-random numbers, so that every run feeds the same data
+static uint nextRandom(uint& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void appendWords(QByteArray& data, uint& seed, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            data += ' ';
+        data += Words[nextRandom(seed) % WordCount];
+    }
+}
+
+// plain ASCII text such as build logs or source files
+static void generateAscii(QByteArray& data, uint& seed)
+{
+    appendWords(data,seed,1 + nextRandom(seed) % 14);
+    data += "\r\n";
+}
+
+// colored output such as 'ls --color' or compiler diagnostics
+static void generateSgr(QByteArray& data, uint& seed)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        switch (nextRandom(seed) % 4)
+        {
+            case 0: data += "\033[01;34m"; break;
+            case 1: data += "\033[01;32m"; break;
+            case 2: data += "\033[38;5;" + QByteArray::number(nextRandom(seed) % 256) + 'm'; break;
+            case 3: data += "\033[1;38;2;" + QByteArray::number(nextRandom(seed) % 256) + ';' +
+                            QByteArray::number(nextRandom(seed) % 256) + ";40m"; break;
+        }
+        appendWords(data,seed,1 + nextRandom(seed) % 3);
+        data += "\033[0m  ";
+    }
+    data += "\r\n";
+}
+
+// UTF-8 encoded CJK text mixed with ASCII
+static void generateCjk(QByteArray& data, uint& seed)
+{
+    const int count = 5 + nextRandom(seed) % 30;
+    for (int i = 0; i < count; i++)
+    {
+        if (nextRandom(seed) % 5 == 0)
+        {
+            data += Words[nextRandom(seed) % WordCount];
+            data += ' ';
+            continue;
+        }
+
+        // CJK unified ideographs, U+4E00 to U+9FA5
+        const uint code = 0x4E00 + nextRandom(seed) % (0x9FA5 - 0x4E00);
+        data += (char)(0xE0 | (code >> 12));
+        data += (char)(0x80 | ((code >> 6) & 0x3F));
+        data += (char)(0x80 | (code & 0x3F));
+    }
+    data += "\r\n";
+}
+
+// output into a scrolling region with a status line above it, as produced
+// by programs such as irssi, mutt or tmux
+static void generateScroll(QByteArray& data, uint& seed)
+{
+    data += "\0337\033[1;1H\033[7m";
+    appendWords(data,seed,4);
+    data += "\033[K\033[0m\0338";
+    data += "\033[3;38r\033[38;1H\n";
+    appendWords(data,seed,1 + nextRandom(seed) % 10);
+
+    switch (nextRandom(seed) % 4)
+    {
+        case 0: data += "\033[10;1H\033[2L"; break;   // insert lines
+        case 1: data += "\033[10;1H\033[2M"; break;   // delete lines
+        case 2: data += "\033[3;1H\033M"; break;      // reverse index at the top of the region
+        default: break;
+    }
+    data += "\033[r";
+}
+
+// the kind of sequences exercised by the vttest screens: alignment pattern,
+// line drawing characters, cursor movement, erasing, double-size lines,
+// insert and delete characters, tab stops and origin mode
+static void generateVttest(QByteArray& data, uint& seed)
+{
+    data += "\033[2J\033[H\033#8";
+    data += "\033[9;10H\033(0lqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqk";
+    for (int row = 10; row < 16; row++)
+        data += "\033[" + QByteArray::number(row) + ";10Hx\033[" +
+                QByteArray::number(row) + ";70Hx";
+    data += "\033[16;10Hmqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqj\033(B";
+    data += "\033[12;12H\033[5C\033[2A\033[3B\033[4D\033[K\033[1J\033[0J";
+    data += "\033[20;1H\033#6";
+    appendWords(data,seed,3);
+    data += "\033[21;1H\033#3";
+    appendWords(data,seed,2);
+    data += "\033[22;1H\033#4";
+    appendWords(data,seed,2);
+    data += "\033[23;1H\033#5\033[4h";
+    appendWords(data,seed,3);
+    data += "\033[4l\033[23;5H\033[3P\033[2@";
+    data += "\033[3g\033[24;1H\033H\033[24;9H\033H\033[24;1H\tA\tB\033[g";
+    data += "\033[5;20r\033[?6h\033[1;1Horigin\033[?6l\033[r";
+    data += "\033[?7l\033[1;75Hnowrap-at-the-margin\033[?7h";
+    data += "\033c";
+}
+
+typedef void (*Generator)(QByteArray&,uint&);
+
+static QByteArray generateCorpus(const QString& name, int size)
+{
+    Generator generator = 0;
+    if (name == "ascii")
+        generator = generateAscii;
+    else if (name == "sgr")
+        generator = generateSgr;
+    else if (name == "cjk")
+        generator = generateCjk;
+    else if (name == "scroll")
+        generator = generateScroll;
+    else if (name == "vttest")
+        generator = generateVttest;
+
+    Q_ASSERT(generator);
+
+    QByteArray data;
+    data.reserve(size + 4096);
+    uint seed = 1;
+    while (data.size() < size)
+        generator(data,seed);
+
+    return data;
+}
+
+static HistoryType* createHistoryType(const QString& spec)
+{
+    const QString type = spec.section(':',0,0);
+    const int size = spec.section(':',1,1).toInt();
+
+    if (type == "none")
+        return new HistoryTypeNone();
+    else if (type == "buffer")
+        return new HistoryTypeBuffer(size > 0 ? size : 1000);
+    else if (type == "file")
+        return new HistoryTypeFile();
+    else if (type == "blockarray")
+        return new HistoryTypeBlockArray(size > 0 ? size : 1024);
+    else if (type == "compressed")
+        return new HistoryTypeCompressed(size);
+
+    return 0;
+}
+
+static double currentTime()
+{
+    struct timeval time;
+    gettimeofday(&time,0);
+    return time.tv_sec + time.tv_usec / 1000000.0;
+}
+
+static long peakResidentSetKB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss;
+}
+
+static void usage()
+{
+    fprintf(stderr,"usage: konsole-bench [--history none|buffer:<lines>|file|blockarray:<KB>|compressed[:<lines>]]\n"
+                   "                     [--size <MB>] [--chunk <bytes>] [--lines <n>] [--columns <n>]\n"
+                   "                     [ascii|sgr|cjk|scroll|vttest|<file>|<capture>] ...\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc,argv);
+    KComponentData componentData("konsole-bench");
+
+    QString historySpec = "buffer:1000";
+    int corpusSize = 16 * 1024 * 1024;
+    int chunkSize = 4096;
+    int lines = 40;
+    int columns = 80;
+    QStringList inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const QString arg = argv[i];
+        const bool hasValue = i+1 < argc;
+
+        if (arg == "--history" && hasValue)
+            historySpec = argv[++i];
+        else if (arg == "--size" && hasValue)
+            corpusSize = atoi(argv[++i]) * 1024 * 1024;
+        else if (arg == "--chunk" && hasValue)
+            chunkSize = atoi(argv[++i]);
+        else if (arg == "--lines" && hasValue)
+            lines = atoi(argv[++i]);
+        else if (arg == "--columns" && hasValue)
+            columns = atoi(argv[++i]);
+        else if (arg.startsWith("--"))
+            usage();
+        else
+            inputs << arg;
+    }
+
+    HistoryType* historyType = createHistoryType(historySpec);
+    if (!historyType || corpusSize <= 0 || chunkSize <= 0 || lines <= 0 || columns <= 0)
+        usage();
+
+    if (inputs.isEmpty())
+    {
+        for (int i = 0; BuiltinCorpora[i]; i++)
+            inputs << BuiltinCorpora[i];
+    }
+
+    printf("history: %s  screen: %dx%d  chunk: %d bytes\n\n",
+           historySpec.toLocal8Bit().constData(),columns,lines,chunkSize);
+    printf("%-20s %10s %10s %12s %14s\n","corpus","MB","seconds","MB/s","lines/s");
+
+    for (int i = 0; i < inputs.count(); i++)
+    {
+        const QString& input = inputs[i];
+        QByteArray data;
+        QList<PtyCaptureRecord> records;
+        PtyCaptureReader reader;
+
+        bool builtin = false;
+        for (int j = 0; BuiltinCorpora[j]; j++)
+            builtin |= (input == BuiltinCorpora[j]);
+
+        if (builtin)
+        {
+            data = generateCorpus(input,corpusSize);
+        }
+        else if (reader.open(input))
+        {
+            PtyCaptureRecord record;
+            while (reader.readRecord(record))
+            {
+                records << record;
+                data += record.data;
+            }
+        }
+        else
+        {
+            QFile file(input);
+            if (!file.open(QIODevice::ReadOnly))
+            {
+                fprintf(stderr,"Unable to open %s\n",input.toLocal8Bit().constData());
+                continue;
+            }
+            data = file.readAll();
+        }
+
+        const int lineCount = data.count('\n');
+
+        // a new emulation for each corpus, so that each starts from the same state
+        Vt102Emulation emulation;
+        emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+        emulation.setImageSize(lines,columns);
+        emulation.setHistory(*historyType);
+
+        const char* bytes = data.constData();
+        const double startTime = currentTime();
+        if (records.isEmpty())
+        {
+            for (int pos = 0; pos < data.size(); pos += chunkSize)
+                emulation.receiveData(bytes + pos,qMin(chunkSize,data.size() - pos));
+        }
+        else
+        {
+            QListIterator<PtyCaptureRecord> iter(records);
+            while (iter.hasNext())
+            {
+                const PtyCaptureRecord& record = iter.next();
+                if (record.type == PtyCaptureRecord::DataRecord)
+                    emulation.receiveData(record.data.constData(),record.data.size());
+                else if (record.lines > 0 && record.columns > 0)
+                    emulation.setImageSize(record.lines,record.columns);
+            }
+        }
+        const double elapsed = qMax(currentTime() - startTime,0.000001);
+
+        const double megabytes = data.size() / (1024.0 * 1024.0);
+        printf("%-20s %10.2f %10.3f %12.2f %14.0f\n",
+               input.toLocal8Bit().constData(),megabytes,elapsed,megabytes / elapsed,lineCount / elapsed);
+    }
+
+    printf("\npeak RSS: %ld KB\n",peakResidentSetKB());
+
+    delete historyType;
+    return 0;
+}
@@ -114,6 +114,10 @@ void fillCommandLineOptions(KCmdLineOptions& options)
 	options.add("noclose",ki18n("Do not close the initial session automatically when it ends."));
     // TODO - Document this option more clearly
     options.add("p \\<property=value>",ki18n("Change the value of a profile property."));
+    options.add("capture \\<file>",ki18n("Record the output of the initial session to 'file'"));
+    options.add("replay \\<file>",ki18n("Replay a recording made with --capture in the initial session"));
+    options.add("replay-fast",ki18n("Replay the recording as fast as possible instead of "
+                                   "at the speed at which it was recorded"));
     options.add("!e \\<cmd>",ki18n("Command to execute"));
     options.add("+[args]",ki18n("Arguments passed to command"));
 }